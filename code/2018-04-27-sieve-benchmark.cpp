@@ -0,0 +1,542 @@
+// g++ -std=c++17 -O2 -pthread -DTHREADS=4 2018-04-27-sieve-benchmark.cpp
+// ./a.out [limit]
+//
+// Counts the primes below `limit` (default 10^9) with each of the
+// sieve iterators below, and with the batch `fill_primes`, and reports
+// primes per second for each.
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef THREADS
+ #define THREADS 1
+#endif
+
+template<typename Int>
+class iotarator {
+    Int value = 0;
+public:
+    explicit iotarator() = default;
+    explicit iotarator(Int v) : value(v) {}
+    Int operator*() const { return value; }
+    iotarator& operator++() { value += 1; return *this; }
+    iotarator operator++(int) = delete;
+
+    bool operator==(const iotarator& rhs) const {
+        return value == rhs.value;
+    }
+    bool operator!=(const iotarator& rhs) const { return !(*this == rhs); }
+};
+
+// The numbers coprime to Modulus (one of 2, 6, 30, 210) form the
+// "spokes" of a wheel; every prime except the few "hub" primes dividing
+// Modulus sits on a spoke. gaps[i] is the distance from spoke i to the
+// next spoke, e.g. for Modulus=30 the spokes are 1, 7, 11, 13, 17, 19,
+// 23, 29 and the gaps are 6, 4, 2, 4, 2, 4, 6, 2.
+template<int Modulus>
+struct wheel {
+    static_assert(Modulus == 2 || Modulus == 6 || Modulus == 30 || Modulus == 210);
+    int hub[4] = {};
+    int hub_size = 0;
+    unsigned char gaps[48] = {};
+    int spokes = 0;
+
+    constexpr wheel() {
+        for (int p : {2, 3, 5, 7}) {
+            if (Modulus % p == 0) hub[hub_size++] = p;
+        }
+        int previous = 1;
+        for (int r = 2; r <= Modulus + 1; ++r) {
+            if (std::gcd(r, Modulus) == 1) {
+                gaps[spokes++] = r - previous;
+                previous = r;
+            }
+        }
+    }
+};
+
+// Like iotarator(2), but after the hub primes it visits only the spokes
+// of the wheel: for Modulus=30 that is 2, 3, 5, 7, 11, 13, 17, 19, 23,
+// 29, 31, 37, ... -- 8 candidates out of every 30 instead of 30.
+// `spoke()` is negative on the hub.
+template<typename Int, int Modulus>
+class wheelerator {
+    static constexpr wheel<Modulus> w{};
+    Int value = 2;
+    int m_spoke = -w.hub_size;  // counts up to -1 through the hub
+public:
+    explicit wheelerator() = default;
+    explicit wheelerator(Int v) { assert(v == 2); }
+    Int operator*() const { return value; }
+    wheelerator& operator++() {
+        if (m_spoke < -1) {
+            m_spoke += 1;
+            value = w.hub[w.hub_size + m_spoke];
+        } else if (m_spoke == -1) {
+            m_spoke = next_spoke(0);
+            value = 1 + w.gaps[0];
+        } else {
+            value += w.gaps[m_spoke];
+            m_spoke = next_spoke(m_spoke);
+        }
+        return *this;
+    }
+    wheelerator operator++(int) = delete;
+
+    int spoke() const { return m_spoke; }
+    static int gap(int spoke) { return w.gaps[spoke]; }
+    static int next_spoke(int spoke) { return (spoke + 1 == w.spokes) ? 0 : spoke + 1; }
+
+    bool operator==(const wheelerator& rhs) const {
+        return value == rhs.value;
+    }
+    bool operator!=(const wheelerator& rhs) const { return !(*this == rhs); }
+};
+
+template<class Iter, class = void>
+struct is_wheel : std::false_type {};
+template<class Iter>
+struct is_wheel<Iter, std::void_t<decltype(std::declval<const Iter&>().spoke())>> : std::true_type {};
+
+// The priority queue used by the unpessimized sieve, with the
+// portable `reemplace_top` from 2018-04-27-sieve-reemplace-portable.cpp.
+template<class T>
+class min_heap : public std::priority_queue<T, std::vector<T>, std::greater<>>
+{
+public:
+    template<class... Args>
+    void reemplace_top(Args&&... args) {
+        this->pop();
+        this->emplace(std::forward<Args>(args)...);
+    }
+};
+
+// The same, but `reemplace_top` overwrites the root and sifts it down
+// once, instead of a full pop followed by a full push. This is what
+// 2018-04-27-sieve-reemplace-nonportable.cpp gets out of libc++'s
+// `std::__sift_down`, written out by hand so that it works anywhere.
+template<class T>
+class sift_down_heap {
+    std::vector<T> c;
+public:
+    bool empty() const { return c.empty(); }
+    const T& top() const { return c.front(); }
+
+    template<class... Args>
+    void emplace(Args&&... args) {
+        c.emplace_back(std::forward<Args>(args)...);
+        std::push_heap(c.begin(), c.end(), std::greater<>());
+    }
+
+    template<class... Args>
+    void reemplace_top(Args&&... args) {
+        T x(std::forward<Args>(args)...);
+        size_t n = c.size();
+        size_t i = 0;
+        while (true) {
+            size_t child = 2*i + 1;
+            if (child >= n) break;
+            if (child + 1 < n && c[child + 1] < c[child]) child += 1;
+            if (!(c[child] < x)) break;
+            c[i] = std::move(c[child]);
+            i = child;
+        }
+        c[i] = std::move(x);
+    }
+};
+
+// A calendar queue (a.k.a. bucket queue) keyed by `next_crossed_off_value`.
+// Entries due within the next DAYS values live in a circular array of
+// buckets, one bucket per value; entries due later wait in a heap until
+// the calendar catches up with them. The sieve only ever pushes keys
+// greater than the current top, and reinsertion `x + p` lands inside the
+// calendar whenever p < DAYS, so in the steady state `reemplace_top`
+// is an O(1) pop_back/push_back. Entries with equal keys come out in
+// no particular order.
+template<class T>
+class calendar_queue {
+    static constexpr size_t DAYS = 1 << 16;
+    using Key = decltype(T::next_crossed_off_value);
+
+    std::vector<std::vector<T>> m_days;  // m_days[k % DAYS] holds the entries due at k
+    size_t m_entries_in_days = 0;
+    Key m_today = 0;                     // all entries are due in [m_today, infinity)
+    min_heap<T> m_future;                // entries due at or after m_today + DAYS
+public:
+    explicit calendar_queue() : m_days(DAYS) {}
+
+    bool empty() const { return m_entries_in_days == 0 && m_future.empty(); }
+    const T& top() const { return m_days[m_today % DAYS].back(); }
+
+    template<class... Args>
+    void emplace(Args&&... args) {
+        insert(T(std::forward<Args>(args)...));
+        turn_to_next_busy_day();
+    }
+
+    template<class... Args>
+    void reemplace_top(Args&&... args) {
+        m_days[m_today % DAYS].pop_back();
+        m_entries_in_days -= 1;
+        insert(T(std::forward<Args>(args)...));
+        turn_to_next_busy_day();
+    }
+
+private:
+    void insert(T x) {
+        assert(x.next_crossed_off_value >= m_today);
+        if (x.next_crossed_off_value - m_today < Key(DAYS)) {
+            m_days[x.next_crossed_off_value % DAYS].push_back(std::move(x));
+            m_entries_in_days += 1;
+        } else {
+            m_future.push(std::move(x));
+        }
+    }
+
+    void turn_to_next_busy_day() {
+        while (m_days[m_today % DAYS].empty()) {
+            if (m_entries_in_days != 0) {
+                m_today += 1;
+            } else if (!m_future.empty()) {
+                m_today = m_future.top().next_crossed_off_value;
+            } else {
+                return;
+            }
+            while (!m_future.empty() && m_future.top().next_crossed_off_value - m_today < Key(DAYS)) {
+                m_days[m_future.top().next_crossed_off_value % DAYS].push_back(m_future.top());
+                m_entries_in_days += 1;
+                m_future.pop();
+            }
+        }
+    }
+};
+
+template<class Int, class Iter, template<class> class MinQueue = min_heap>
+class sieverator {
+    Int m_current;
+    Iter m_iter;
+
+    explicit sieverator() {}  // used by .end()
+public:
+    explicit sieverator(Iter it) :
+        m_current(*it),
+        m_iter(it)
+    {}
+    sieverator begin() { return std::move(*this); }
+    sieverator end() const { return sieverator{}; }
+    bool operator==(const sieverator&) const { return false; }
+    bool operator!=(const sieverator&) const { return true; }
+
+    Int operator*() const {
+        return m_current;
+    }
+
+    sieverator& operator++() {
+        cross_off_multiples_of_prime(m_current);
+        do {
+            ++m_iter;
+            m_current = *m_iter;
+        } while (is_already_crossed_off(m_current));
+        return *this;
+    }
+
+    sieverator& operator++(int) = delete;
+
+private:
+    struct pair {
+        Int next_crossed_off_value;
+        Int prime_increment;
+        explicit pair(Int a, Int b) : next_crossed_off_value(a), prime_increment(b) {}
+        bool operator<(const pair& rhs) const {
+            return next_crossed_off_value < rhs.next_crossed_off_value ? true
+                 : next_crossed_off_value > rhs.next_crossed_off_value ? false
+                 : prime_increment < rhs.prime_increment;
+        }
+        bool operator>(const pair& rhs) const { return rhs < *this; }
+    };
+    // With a wheel, the multiples of a prime p that we need to cross off
+    // are p*k for k on a spoke; `spoke` says which spoke k is on, so that
+    // the next one is p*(k + gap(spoke)).
+    struct spoked_pair : pair {
+        int spoke;
+        explicit spoked_pair(Int a, Int b, int s) : pair(a, b), spoke(s) {}
+    };
+    static constexpr bool wheeled = is_wheel<Iter>::value;
+    MinQueue<std::conditional_t<wheeled, spoked_pair, pair>> m_pq;
+
+    void cross_off_multiples_of_prime(Int value) {
+        if constexpr (wheeled) {
+            // The hub primes have no multiples on the wheel.
+            if (m_iter.spoke() >= 0) {
+                m_pq.emplace(value * value, value, m_iter.spoke());
+            }
+        } else {
+            m_pq.emplace(value * value, value);
+        }
+    }
+
+    bool is_already_crossed_off(Int value) {
+        if constexpr (wheeled) {
+            if (m_pq.empty()) return false;
+        }
+        if (value != m_pq.top().next_crossed_off_value) {
+            return false;
+        } else {
+            do {
+                auto x = m_pq.top();
+                if constexpr (wheeled) {
+                    m_pq.reemplace_top(x.next_crossed_off_value + x.prime_increment * Iter::gap(x.spoke), x.prime_increment, Iter::next_spoke(x.spoke));
+                } else {
+                    m_pq.reemplace_top(x.next_crossed_off_value + x.prime_increment, x.prime_increment);
+                }
+            } while (value == m_pq.top().next_crossed_off_value);
+            return true;
+        }
+    }
+};
+
+// Yields the same infinite sequence of primes as `sieverator`, but
+// instead of one heap entry per prime it sieves the odd numbers in
+// fixed-size windows that fit in L1 cache. Each sieving prime remembers
+// the next odd multiple it has yet to cross off; when the window runs
+// out of primes we slide it forward and cross off the next window.
+// The sieving primes themselves come from a nested instance, which only
+// ever has to get as far as the square root of our window.
+template<class Int>
+class segmented_sieverator {
+    static constexpr int SEGMENT = 32 * 1024;  // odd numbers per window
+
+    Int m_current;
+    Int m_lo;     // the window covers the odd numbers in [m_lo, m_lo + 2*SEGMENT)
+    int m_index;  // of m_current in the window; -1 while m_current is 2
+    std::vector<unsigned char> m_crossed_off;
+
+    struct base_prime {
+        Int prime;
+        Int next_crossed_off_value;  // always odd, always >= m_lo
+    };
+    std::vector<base_prime> m_base_primes;
+    std::unique_ptr<segmented_sieverator> m_base_source;
+
+    explicit segmented_sieverator() {}  // used by .end()
+public:
+    template<class Iter>
+    explicit segmented_sieverator(Iter it) :
+        m_current(*it),
+        m_lo(3),
+        m_index(-1),
+        m_crossed_off(SEGMENT)
+    {
+        assert(*it == 2);
+        sieve_window();
+    }
+    segmented_sieverator begin() { return std::move(*this); }
+    segmented_sieverator end() const { return segmented_sieverator{}; }
+    bool operator==(const segmented_sieverator&) const { return false; }
+    bool operator!=(const segmented_sieverator&) const { return true; }
+
+    Int operator*() const {
+        return m_current;
+    }
+
+    segmented_sieverator& operator++() {
+        do {
+            m_index += 1;
+            if (m_index == SEGMENT) {
+                m_lo += 2 * SEGMENT;
+                m_index = 0;
+                sieve_window();
+            }
+        } while (m_crossed_off[m_index]);
+        m_current = m_lo + 2 * Int(m_index);
+        return *this;
+    }
+
+    segmented_sieverator& operator++(int) = delete;
+
+private:
+    void sieve_window() {
+        Int hi = m_lo + 2 * SEGMENT;
+        unsigned char *crossed_off = m_crossed_off.data();
+        std::fill_n(crossed_off, SEGMENT, 0);
+        if (m_lo == 3) {
+            // The first window holds its own sieving primes.
+            for (Int p = 3; p * p < hi; p += 2) {
+                if (!crossed_off[(p - 3) / 2]) {
+                    for (Int m = p * p; m < hi; m += 2 * p) {
+                        crossed_off[(m - 3) / 2] = 1;
+                    }
+                }
+            }
+            return;
+        }
+        if (m_base_source == nullptr) {
+            m_base_source.reset(new segmented_sieverator(iotarator<Int>(2)));
+            ++*m_base_source;  // skip 2
+        }
+        for (Int p = **m_base_source; p * p < hi; p = *++*m_base_source) {
+            Int m = std::max(p * p, (m_lo + p - 1) / p * p);
+            if (m % 2 == 0) m += p;
+            m_base_primes.push_back({p, m});
+        }
+        for (base_prime& bp : m_base_primes) {
+            Int m = bp.next_crossed_off_value;
+            Int step = 2 * bp.prime;
+            for (; m < hi; m += step) {
+                crossed_off[(m - m_lo) / 2] = 1;
+            }
+            bp.next_crossed_off_value = m;
+        }
+    }
+};
+
+// Writes the primes in [lo, hi) to [first, last) in increasing order,
+// and returns the end of what it wrote. If they don't all fit, the
+// output stops at `last`; carry on from one past the last prime written.
+// This sieves the odd numbers in L1-sized windows, like
+// segmented_sieverator, but the base primes up to sqrt(hi) are found
+// up front, so each chunk of windows can be sieved independently.
+// The chunks are handed out to `threads` workers a round at a time,
+// and each round's output is copied out in order.
+template<class Int>
+Int *fill_primes(Int lo, Int hi, Int *first, Int *last, int threads = THREADS)
+{
+    assert(threads >= 1);
+    constexpr int SEGMENT = 32 * 1024;  // odd numbers per window
+    constexpr Int CHUNK = 2 * SEGMENT * 16;  // numbers per unit of work
+    const int CHUNKS_PER_ROUND = 4 * threads;
+
+    Int *out = first;
+    if (lo <= 2 && 2 < hi && out != last) *out++ = 2;
+    lo = std::max(lo, Int(3));
+    lo += (lo % 2 == 0);
+    if (lo >= hi) return out;
+
+    std::vector<Int> base_primes;
+    for (Int p : segmented_sieverator<Int>(iotarator<Int>(2))) {
+        if (p * p >= hi) break;
+        if (p != 2) base_primes.push_back(p);
+    }
+
+    auto sieve_chunk = [&](Int chunk_lo, Int chunk_hi, std::vector<Int>& primes) {
+        unsigned char crossed_off[SEGMENT];
+        primes.clear();
+        for (Int window_lo = chunk_lo; window_lo < chunk_hi; window_lo += 2 * SEGMENT) {
+            Int window_hi = std::min(window_lo + 2 * SEGMENT, chunk_hi);
+            int n = (window_hi - window_lo + 1) / 2;
+            std::fill_n(crossed_off, n, 0);
+            for (Int p : base_primes) {
+                if (p * p >= window_hi) break;
+                Int m = std::max(p * p, (window_lo + p - 1) / p * p);
+                if (m % 2 == 0) m += p;
+                for (; m < window_hi; m += 2 * p) {
+                    crossed_off[(m - window_lo) / 2] = 1;
+                }
+            }
+            for (int i = 0; i < n; ++i) {
+                if (!crossed_off[i]) primes.push_back(window_lo + 2 * Int(i));
+            }
+        }
+    };
+
+    std::vector<std::vector<Int>> round(CHUNKS_PER_ROUND);
+    for (Int round_lo = lo; round_lo < hi && out != last; ) {
+        Int round_chunks = std::min(Int(CHUNKS_PER_ROUND), (hi - round_lo + CHUNK - 1) / CHUNK);
+        std::atomic<int> next(0);
+        auto work = [&]() {
+            for (int i; (i = next++) < round_chunks; ) {
+                Int chunk_lo = round_lo + i * CHUNK;
+                sieve_chunk(chunk_lo, std::min(chunk_lo + CHUNK, hi), round[i]);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < threads; ++t) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& t : workers) t.join();
+        for (int i = 0; i < round_chunks && out != last; ++i) {
+            size_t n = std::min(round[i].size(), size_t(last - out));
+            out = std::copy_n(round[i].begin(), n, out);
+        }
+        round_lo += round_chunks * CHUNK;
+    }
+    return out;
+}
+
+static void report(const char *name, int64_t count, int64_t sum, std::chrono::steady_clock::time_point start)
+{
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    printf("%-24s %lld primes (sum %lld) in %.3fs: %.0f primes/sec\n",
+        name, (long long)count, (long long)sum, seconds, count / seconds);
+}
+
+template<class Sieve, class Iter = iotarator<int64_t>>
+void benchmark(const char *name, int64_t limit)
+{
+    auto start = std::chrono::steady_clock::now();
+    Iter it(2);
+    Sieve sieve(it);
+    int64_t count = 0;
+    int64_t sum = 0;
+    for (int64_t p : sieve) {
+        if (p >= limit) break;
+        count += 1;
+        sum += p;
+    }
+    report(name, count, sum, start);
+}
+
+void benchmark_batch(const char *name, int64_t limit, int threads)
+{
+    constexpr int64_t BLOCK = 1 << 22;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<int64_t> buffer(BLOCK / 2 + 1);
+    int64_t count = 0;
+    int64_t sum = 0;
+    for (int64_t lo = 0; lo < limit; lo += BLOCK) {
+        int64_t hi = std::min(lo + BLOCK, limit);
+        int64_t *end = fill_primes(lo, hi, buffer.data(), buffer.data() + buffer.size(), threads);
+        for (int64_t *p = buffer.data(); p != end; ++p) {
+            count += 1;
+            sum += *p;
+        }
+    }
+    report(name, count, sum, start);
+}
+
+int main(int argc, char **argv)
+{
+    int64_t limit = (argc >= 2) ? atoll(argv[1]) : 1000000000;
+    using Iota = iotarator<int64_t>;
+    using Wheel6 = wheelerator<int64_t, 6>;
+    using Wheel30 = wheelerator<int64_t, 30>;
+    using Wheel210 = wheelerator<int64_t, 210>;
+    if (THREADS > 1) {
+        char name[32];
+        snprintf(name, sizeof name, "batch, %d threads", THREADS);
+        benchmark_batch(name, limit, THREADS);
+    }
+    benchmark_batch("batch, 1 thread", limit, 1);
+    benchmark<segmented_sieverator<int64_t>>("segmented", limit);
+    benchmark<sieverator<int64_t, Wheel210, calendar_queue>, Wheel210>("calendar queue, mod 210", limit);
+    benchmark<sieverator<int64_t, Wheel30, calendar_queue>, Wheel30>("calendar queue, mod 30", limit);
+    benchmark<sieverator<int64_t, Wheel6, calendar_queue>, Wheel6>("calendar queue, mod 6", limit);
+    benchmark<sieverator<int64_t, Iota, calendar_queue>>("calendar queue", limit);
+    benchmark<sieverator<int64_t, Wheel210, sift_down_heap>, Wheel210>("heap, sift-down, mod 210", limit);
+    benchmark<sieverator<int64_t, Iota, sift_down_heap>>("heap, sift-down", limit);
+    benchmark<sieverator<int64_t, Iota, min_heap>>("heap, pop+push", limit);
+}
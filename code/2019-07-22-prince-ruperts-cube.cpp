@@ -1,11 +1,28 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
 #include <iostream>
 #include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Compile with "g++ -std=c++17 -O2 -march=native -pthread prince-ruperts-cube.cpp".
+// Add -DTHREADS=8 to integrate on 8 threads at once.
+// Add -DNAIVE to sample every point with is_in_hole() instead.
+// Add -DEXACT to skip sampling and just compute the exact volume.
+// Add -DOCTREE=12 to estimate the volume with an adaptive octree instead,
+// reporting its error at each depth from 1 to 12.
 
 #ifndef SIDE
 #define SIDE 300
 #endif
 
-using T = int;
+#ifndef THREADS
+#define THREADS 1
+#endif
+
+using T = long long;
 
 struct Point {
     double x, y, z;
@@ -30,6 +47,10 @@ struct Point {
         return Point{p.x - q.x, p.y - q.y, p.z - q.z};
     }
 
+    friend constexpr Point operator*(double k, Point p) {
+        return Point{k * p.x, k * p.y, k * p.z};
+    }
+
     friend constexpr bool operator==(Point a, Point b) {
         return a.x == b.x && a.y == b.y && a.z == b.z;
     }
@@ -114,8 +135,283 @@ inline double is_in_hole(double x, double y, double z)
     }
 }
 
+// The integrator below samples the same SIDE^3 points as is_in_hole(), much
+// faster. Each plane's signed distance is an affine function of (x,y,z), so we
+// evaluate it once per row and then just add a precomputed dz*z. The vertical plane's
+// normal has no z component, so d1 is constant along each row, and a row whose
+// d1 exceeds half_side_of_hole contributes nothing to the volume at all.
+// The z-loop handles LANES points at a time using GCC's vector extensions;
+// with -march=native that's AVX2 (4 lanes) or AVX-512 (8 lanes).
+// Each thread integrates its own slab of x-values into its own Tally,
+// and the main thread combines them at the end.
+
+#if defined(__AVX512F__)
+#define LANES 8
+#elif defined(__AVX__)
+#define LANES 4
+#else
+#define LANES 2
+#endif
+
+typedef double vdouble __attribute__((vector_size(8 * LANES)));
+typedef long long vint __attribute__((vector_size(8 * LANES)));
+
+struct AffineDistance {
+    // The signed distance to a plane, as a*x + b*y + c*z + d.
+    double a, b, c, d;
+
+    static AffineDistance to_plane(Point N, Point X) {
+        double len = sqrt(N.mag2());
+        return AffineDistance{N.x / len, N.y / len, N.z / len, -N.dot(X) / len};
+    }
+
+    double at(Point p) const { return a*p.x + b*p.y + c*p.z + d; }
+    Point normal() const { return Point{a, b, c}; }
+    AffineDistance flipped() const { return AffineDistance{-a, -b, -c, -d}; }
+};
+
+// These are the same planes as in distance_to_{vertical,horizontal}_plane.
+static constexpr Point dir1 = {X2.y - X1.y, X1.x - X2.x, 0};
+static constexpr Point dir2 = {X2.x - X1.x, X2.y - X1.y, X2.z - X1.z};
+static const AffineDistance vertical_plane = AffineDistance::to_plane(dir1, X1);
+static const AffineDistance horizontal_plane = AffineDistance::to_plane(dir1.cross(dir2), X1);
+
+struct Tally {
+    double hole_volume = 0.0;
+    double max_d1 = -1;
+    double max_d2 = -1;
+};
+
+Tally integrate_slab(T xlo, T xhi)
+{
+    static_assert(dir1.z == 0, "d1 should be constant along z");
+    const AffineDistance& p1 = vertical_plane;
+    const AffineDistance& p2 = horizontal_plane;
+    const double half_side_of_hole = 0.5;
+    const double dz = p2.c / SIDE;  // the change in signed d2 from z to z+1
+
+    std::vector<double> dz_times_z(SIDE);
+    for (T z = 0; z < SIDE; ++z) {
+        dz_times_z[z] = dz * z;
+    }
+    const vint magnitude_bits = vint{} + 0x7fffffffffffffffLL;
+
+    Tally t;
+    for (T x = xlo; x < xhi; ++x) {
+      double xd = double(x) / SIDE;
+      for (T y = 0; y < SIDE; ++y) {
+        double yd = double(y) / SIDE;
+        double d1 = fabs(p1.a*xd + p1.b*yd + p1.d);
+        double e2 = p2.a*xd + p2.b*yd + p2.d;  // signed d2 at z=0
+        t.max_d1 = std::max(d1, t.max_d1);
+        // |d2| is convex along the row, so its maximum is at one end.
+        t.max_d2 = std::max({t.max_d2, fabs(e2), fabs(e2 + dz*(SIDE-1))});
+        if (d1 > half_side_of_hole) {
+            continue;
+        }
+        // Count the points with d2 < 0.5 and with d2 <= 0.5.
+        // Vector comparisons yield -1 for true, hence the subtraction.
+        vint inside = {};
+        vint inside_or_on = {};
+        T zi = 0;
+        for ( ; zi + LANES <= SIDE; zi += LANES) {
+            vdouble d2;
+            memcpy(&d2, &dz_times_z[zi], sizeof d2);
+            d2 += e2;
+            d2 = (vdouble)((vint)d2 & magnitude_bits);  // fabs
+            inside -= (d2 < half_side_of_hole);
+            inside_or_on -= (d2 <= half_side_of_hole);
+        }
+        T n_inside = 0, n_inside_or_on = 0;
+        for (int i = 0; i < LANES; ++i) {
+            n_inside += inside[i];
+            n_inside_or_on += inside_or_on[i];
+        }
+        for ( ; zi < SIDE; ++zi) {
+            double d2 = fabs(e2 + dz_times_z[zi]);
+            n_inside += (d2 < half_side_of_hole);
+            n_inside_or_on += (d2 <= half_side_of_hole);
+        }
+        if (d1 < half_side_of_hole) {
+            t.hole_volume += n_inside + 0.5 * (n_inside_or_on - n_inside);
+        } else {
+            t.hole_volume += 0.5 * n_inside_or_on;
+        }
+      }
+    }
+    return t;
+}
+
+// The hole is the set of points within half_side_of_hole of both planes;
+// that is, the intersection of four half-spaces. So the part of the cube
+// inside the hole is a convex polytope, and we can compute its volume exactly
+// by clipping the cube against each half-space in turn.
+
+using Face = std::vector<Point>;
+
+// Keep the part of `faces` where h.at(p) <= 0, closing the cut with a new face.
+std::vector<Face> clip(const std::vector<Face>& faces, const AffineDistance& h)
+{
+    std::vector<Face> result;
+    Face cap;
+    for (const Face& face : faces) {
+        Face clipped;
+        for (size_t i = 0; i < face.size(); ++i) {
+            Point p = face[i];
+            Point q = face[(i + 1) % face.size()];
+            double hp = h.at(p);
+            double hq = h.at(q);
+            if (hp <= 0) {
+                clipped.push_back(p);
+            }
+            if (hp == 0) {
+                cap.push_back(p);
+            }
+            if ((hp < 0 && hq > 0) || (hp > 0 && hq < 0)) {
+                Point r = p + (hp / (hp - hq)) * (q - p);
+                clipped.push_back(r);
+                cap.push_back(r);
+            }
+        }
+        if (clipped.size() >= 3) {
+            result.push_back(std::move(clipped));
+        }
+    }
+    if (cap.size() >= 3) {
+        // Sort the cap's vertices by angle around their centroid. (Each one
+        // shows up twice, once per adjacent face; that's harmless.)
+        Point center = {0, 0, 0};
+        for (Point p : cap) {
+            center = center + p;
+        }
+        center = (1.0 / cap.size()) * center;
+        Point n = h.normal();
+        Point u = (fabs(n.x) < 0.9 ? Point{1, 0, 0} : Point{0, 1, 0}).cross(n);
+        Point v = n.cross(u);
+        std::sort(cap.begin(), cap.end(), [&](Point p, Point q) {
+            return atan2((p - center).dot(v), (p - center).dot(u)) <
+                   atan2((q - center).dot(v), (q - center).dot(u));
+        });
+        result.push_back(std::move(cap));
+    }
+    return result;
+}
+
+double volume_of_convex_polytope(const std::vector<Face>& faces)
+{
+    // Sum the tetrahedra joining an interior point to a fan of each face.
+    Point center = {0, 0, 0};
+    int n = 0;
+    for (const Face& face : faces) {
+        for (Point p : face) {
+            center = center + p;
+            n += 1;
+        }
+    }
+    center = (1.0 / n) * center;
+    double volume = 0;
+    for (const Face& face : faces) {
+        for (size_t i = 1; i + 1 < face.size(); ++i) {
+            Point a = face[0] - center;
+            Point b = face[i] - center;
+            Point c = face[i+1] - center;
+            volume += fabs(a.dot(b.cross(c))) / 6;
+        }
+    }
+    return volume;
+}
+
+double hole_volume_exactly()
+{
+    const double half_side_of_hole = 0.5;
+    std::vector<Face> cube = {
+        {{0,0,0}, {0,1,0}, {1,1,0}, {1,0,0}},
+        {{0,0,1}, {1,0,1}, {1,1,1}, {0,1,1}},
+        {{0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}},
+        {{0,1,0}, {0,1,1}, {1,1,1}, {1,1,0}},
+        {{0,0,0}, {0,0,1}, {0,1,1}, {0,1,0}},
+        {{1,0,0}, {1,1,0}, {1,1,1}, {1,0,1}},
+    };
+    for (AffineDistance plane : {vertical_plane, horizontal_plane}) {
+        plane.d -= half_side_of_hole;
+        cube = clip(cube, plane);
+        plane.d += 2 * half_side_of_hole;
+        cube = clip(cube, plane.flipped());
+    }
+    return volume_of_convex_polytope(cube);
+}
+
+// The adaptive octree only refines the cells that straddle a face of the hole.
+// An affine function's extremes over a cell are at its corners, so for each
+// of the four half-spaces we can tell whether a cell is entirely inside it,
+// entirely outside it, or neither. At the maximum depth, a straddling cell is
+// classified by its center point.
+
+struct OctreeTally {
+    double hole_volume = 0.0;
+    long long leaves = 0;
+};
+
+void integrate_octree(Point corner, double side, int depth, OctreeTally& t)
+{
+    const double half_side_of_hole = 0.5;
+    bool straddles = false;
+    for (const AffineDistance& plane : {vertical_plane, horizontal_plane}) {
+        double lo = plane.at(corner);
+        double hi = lo;
+        for (double k : {plane.a, plane.b, plane.c}) {
+            (k < 0 ? lo : hi) += k * side;
+        }
+        if (lo >= half_side_of_hole || hi <= -half_side_of_hole) {
+            return;  // entirely outside the hole
+        }
+        if (lo <= -half_side_of_hole || hi >= half_side_of_hole) {
+            straddles = true;
+        }
+    }
+    if (!straddles) {
+        t.hole_volume += side * side * side;
+    } else if (depth == 0) {
+        t.leaves += 1;
+        Point center = corner + Point{side/2, side/2, side/2};
+        if (fabs(vertical_plane.at(center)) < half_side_of_hole &&
+            fabs(horizontal_plane.at(center)) < half_side_of_hole) {
+            t.hole_volume += side * side * side;
+        }
+    } else {
+        double s = side / 2;
+        for (int i = 0; i < 8; ++i) {
+            Point c = corner + Point{(i & 1) * s, ((i >> 1) & 1) * s, ((i >> 2) & 1) * s};
+            integrate_octree(c, s, depth - 1, t);
+        }
+    }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 int main()
 {
+    auto start = std::chrono::steady_clock::now();
+    double exact = 1.0 - hole_volume_exactly();
+#if defined(EXACT)
+    std::cout << "The volume of the remaining cube is exactly " << exact
+              << " (computed in " << seconds_since(start) << "s).\n";
+#elif defined(OCTREE)
+    std::cout << "The volume of the remaining cube is exactly " << exact << ".\n";
+    for (int depth = 1; depth <= OCTREE; ++depth) {
+        start = std::chrono::steady_clock::now();
+        OctreeTally t;
+        integrate_octree(Point{0, 0, 0}, 1.0, depth, t);
+        double estimate = 1.0 - t.hole_volume;
+        std::cout << "Depth " << depth << ": about " << estimate
+                  << " (error " << (estimate - exact) << ") from " << t.leaves
+                  << " boundary cells in " << seconds_since(start) << "s\n";
+    }
+#else
+#ifdef NAIVE
     double hole_volume = 0.0;
     for (T x = 0; x < SIDE; ++x) {
       double xd = double(x) / SIDE;
@@ -127,10 +423,30 @@ int main()
         }
       }
     }
+#else
+    std::vector<Tally> tallies(THREADS);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < THREADS; ++i) {
+        threads.emplace_back([&tallies, i]() {
+            tallies[i] = integrate_slab(SIDE * i / THREADS, SIDE * (i+1) / THREADS);
+        });
+    }
+    double hole_volume = 0.0;
+    for (int i = 0; i < THREADS; ++i) {
+        threads[i].join();
+        hole_volume += tallies[i].hole_volume;
+        max_d1 = std::max(tallies[i].max_d1, max_d1);
+        max_d2 = std::max(tallies[i].max_d2, max_d2);
+    }
+#endif
     std::cout << "max_d1 = " << max_d1 << "\n";
     std::cout << "max_d2 = " << max_d2 << "\n";
-    T total = SIDE * SIDE * SIDE;
+    T total = T(SIDE) * SIDE * SIDE;
     std::cout << hole_volume << " of " << total << " points were inside the hole.\n";
     std::cout << (total - hole_volume) << " of " << total << " points remain.\n";
-    std::cout << "The volume of the remaining cube is about " << (double(total - hole_volume) / double(total)) << ".\n";
+    double estimate = double(total - hole_volume) / double(total);
+    std::cout << "The volume of the remaining cube is about " << estimate << ".\n";
+    std::cout << "The exact volume is " << exact << " (error " << (estimate - exact)
+              << "); sampling took " << seconds_since(start) << "s.\n";
+#endif
 }
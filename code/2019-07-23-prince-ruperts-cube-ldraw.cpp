@@ -1,5 +1,12 @@
 #include <iostream>
+#include <atomic>
+#include <cassert>
 #include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
 #include <vector>
 #include <algorithm>
 #include <random>
@@ -108,90 +115,488 @@ struct Lego {
     constexpr bool operator!=(const Lego& rhs) const { return !(*this == rhs); }
 };
 
+// Which kind of voxel, if any, is still waiting to be covered by a brick.
+// The packer tests and clears voxels here in O(1), instead of searching for
+// them in (and erasing them from) the shuffled work lists.
+enum Voxel : unsigned char { EMPTY, PLATE, TILE };
+
+class Occupancy {
+public:
+    Occupancy() : cells_(size_t(SIDE*2) * (SIDE*2) * (SIDE*5), EMPTY) {}
+
+    Voxel at(const Lego& g) const {
+        if (g.x >= SIDE*2 || g.y >= SIDE*2 || g.z >= SIDE*5) return EMPTY;
+        return cells_[index(g)];
+    }
+    void set(const Lego& g, Voxel v) { cells_[index(g)] = v; }
+
+private:
+    static size_t index(const Lego& g) {
+        return (size_t(g.z) * (SIDE*2) + g.y) * (SIDE*2) + g.x;
+    }
+    std::vector<Voxel> cells_;
+};
+
 struct Piece {
     const char *filename_;
     int x_, y_, z_;
     std::vector<Lego> offsets_;
 
-    bool doit(Lego mainguy, std::vector<Lego>& v) const {
-        std::vector<int> to_remove;
+    bool doit(Lego mainguy, Occupancy& grid, Voxel kind) const {
         for (const Lego& offset : offsets_) {
-            Lego lookingfor = mainguy + offset;
-            auto it = std::find(v.begin(), v.end(), lookingfor);
-            if (it == v.end()) return false;
-            to_remove.push_back(it - v.begin());
+            if (grid.at(mainguy + offset) != kind) return false;
+        }
+        for (const Lego& offset : offsets_) {
+            grid.set(mainguy + offset, EMPTY);
+        }
+        return true;
+    }
+};
+
+static const Piece plate_pieces[] = {
+    Piece{ "3001.dat",  +30, +10, -24, {
+        Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}, Lego{1,0,0}, Lego{1,0,1}, Lego{1,0,2},
+        Lego{0,1,0}, Lego{0,1,1}, Lego{0,1,2}, Lego{1,1,0}, Lego{1,1,1}, Lego{1,1,2},
+        Lego{2,0,0}, Lego{2,0,1}, Lego{2,0,2}, Lego{3,0,0}, Lego{3,0,1}, Lego{3,0,2},
+        Lego{2,1,0}, Lego{2,1,1}, Lego{2,1,2}, Lego{3,1,0}, Lego{3,1,1}, Lego{3,1,2},
+    } },
+    Piece{ "6223.dat",  +10, +10, -24, {Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}, Lego{1,0,0}, Lego{1,0,1}, Lego{1,0,2}, Lego{0,1,0}, Lego{0,1,1}, Lego{0,1,2}, Lego{1,1,0}, Lego{1,1,1}, Lego{1,1,2}} },
+    Piece{ "3004.dat", +10,  +0, -24, {Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}, Lego{1,0,0}, Lego{1,0,1}, Lego{1,0,2}} },
+    Piece{ "30071.dat",  +0,  +0, -24, {Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}} },
+    Piece{ "30008.dat",  +0,  +0,  -8, {Lego{0,0,0}} },
+};
+
+static const Piece tile_pieces[] = {
+    Piece{ "63327.dat", +10, +10,  -8, {Lego{0,0,0}, Lego{1,0,0}, Lego{0,1,0}, Lego{1,1,0}} },
+    Piece{ "63864.dat", +20,  +0,  -8, {Lego{0,0,0}, Lego{1,0,0}, Lego{2,0,0}} },
+    Piece{ "30070.dat", +10,  +0,  -8, {Lego{0,0,0}, Lego{1,0,0}} },
+    Piece{ "30039.dat",  +0,  +0,  -8, {Lego{0,0,0}} },
+};
+
+struct Placement {
+    const Piece *piece;
+    Lego mainguy;
+};
+
+void print_placement(const Placement& pl)
+{
+    const Piece& p = *pl.piece;
+    const Lego& mainguy = pl.mainguy;
+    printf("1 7 %d %d %d 1 0 0 0 1 0 0 0 1 %s\n", mainguy.x*20 + p.x_, mainguy.z*-8 + p.z_, mainguy.y*20 + p.y_, p.filename_);
+}
+
+// Cover every voxel of this kind, taking the last uncovered voxel in `work`
+// each time, exactly as if covered voxels had been erased from `work`.
+void pack(const std::vector<Lego>& work, Occupancy& grid, Voxel kind, const Piece *poss, int nposs, std::vector<Placement>& out)
+{
+    for (auto it = work.rbegin(); it != work.rend(); ++it) {
+        const Lego& mainguy = *it;
+        if (grid.at(mainguy) != kind) continue;  // already covered
+        for (int i = 0; i < nposs; ++i) {
+            const Piece& p = poss[i];
+            if (p.doit(mainguy, grid, kind)) {
+                out.push_back(Placement{&p, mainguy});
+                print_placement(out.back());
+                break;
+            }
+        }
+    }
+}
+
+// The OPTIMAL engine works one layer at a time. Bricks are three plates tall,
+// so the plate voxels are cut into courses three plates thick, starting at z=0;
+// within a course, each (x,y) column that is solid all the way up is covered by
+// a brick, and every other plate voxel by a 1x1 plate. The tiles on each
+// z-level form a layer of their own. Every layer is then a 2D region to be
+// covered exactly by the pieces' rectangular footprints, using as few pieces
+// as we can find. The layers are independent, so THREADS workers pack them at
+// once, and the main thread prints them in order.
+//
+// Rectangles can't rotate, so the first uncovered cell in row-major order
+// must be the top-left corner of whichever piece covers it. That gives an
+// exact branch-and-bound search with at most one branch per piece type.
+// Connected regions of up to EXACT_CELLS cells get that search; bigger ones
+// are packed greedily and then improved by re-searching WINDOW_X by WINDOW_Y
+// windows, until no window gets any better. Each search gives up after
+// NODE_LIMIT nodes and keeps the best packing found so far, so the result is
+// optimal only when the limit isn't hit.
+
+#ifndef THREADS
+#define THREADS 1
+#endif
+
+#ifndef EXACT_CELLS
+#define EXACT_CELLS 48
+#endif
+
+#ifndef NODE_LIMIT
+#define NODE_LIMIT 1000000
+#endif
+
+#ifndef WINDOW_X
+#define WINDOW_X 8
+#endif
+
+#ifndef WINDOW_Y
+#define WINDOW_Y 4
+#endif
+
+struct Footprint {
+    const Piece *piece;
+    int w, h;
+};
+
+std::vector<Footprint> footprints(const Piece *poss, int nposs, int height)
+{
+    // The pieces that are `height` plates tall, largest first.
+    std::vector<Footprint> result;
+    for (int i = 0; i < nposs; ++i) {
+        int w = 0, h = 0, d = 0;
+        for (const Lego& o : poss[i].offsets_) {
+            w = std::max(w, o.x + 1);
+            h = std::max(h, o.y + 1);
+            d = std::max(d, o.z + 1);
+        }
+        assert(int(poss[i].offsets_.size()) == w * h * d);
+        if (d == height) {
+            result.push_back(Footprint{&poss[i], w, h});
+        }
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Footprint& a, const Footprint& b) {
+        return a.w * a.h > b.w * b.h;
+    });
+    return result;
+}
+
+class LayerPacker {
+public:
+    static constexpr int W = SIDE*2;
+
+    struct Rect {
+        int x, y, f;  // top-left corner and index into fps_
+    };
+
+    explicit LayerPacker(std::vector<Footprint> fps) : fps_(std::move(fps)) {}
+
+    // Cover the cells with todo[y*W+x] set, using as few rectangles as we can.
+    std::vector<Rect> pack(const std::vector<bool>& todo) {
+        todo_ = todo;
+        rects_.clear();
+        owner_.assign(W * W, -1);
+        std::vector<bool> free = todo;
+        for (int y = 0; y < W; ++y) {
+            for (int x = 0; x < W; ++x) {
+                if (!free[y*W + x]) continue;
+                for (int f = 0; f < int(fps_.size()); ++f) {
+                    if (fits(free, W, W, x, y, f)) {
+                        place(free, W, x, y, f, false);
+                        add_rect(Rect{x, y, f});
+                        break;
+                    }
+                }
+            }
+        }
+        for (const std::vector<int>& component : components()) {
+            if (int(component.size()) <= EXACT_CELLS) {
+                improve(component);
+            }
+        }
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            for (int y0 = 0; y0 < W; y0 += WINDOW_Y / 2) {
+                for (int x0 = 0; x0 < W; x0 += WINDOW_X / 2) {
+                    std::vector<int> cells;
+                    for (int y = y0; y < std::min(W, y0 + WINDOW_Y); ++y) {
+                        for (int x = x0; x < std::min(W, x0 + WINDOW_X); ++x) {
+                            if (todo_[y*W + x]) cells.push_back(y*W + x);
+                        }
+                    }
+                    improved |= improve(cells);
+                }
+            }
+        }
+        std::vector<Rect> result;
+        for (const Rect& r : rects_) {
+            if (r.f >= 0) result.push_back(r);
+        }
+        return result;
+    }
+
+    const Footprint& footprint(int f) const { return fps_[f]; }
+
+private:
+    bool fits(const std::vector<bool>& free, int bw, int bh, int x, int y, int f) const {
+        const Footprint& fp = fps_[f];
+        if (x + fp.w > bw || y + fp.h > bh) return false;
+        for (int dy = 0; dy < fp.h; ++dy) {
+            for (int dx = 0; dx < fp.w; ++dx) {
+                if (!free[(y+dy)*bw + (x+dx)]) return false;
+            }
+        }
+        return true;
+    }
+
+    void place(std::vector<bool>& free, int bw, int x, int y, int f, bool value) const {
+        const Footprint& fp = fps_[f];
+        for (int dy = 0; dy < fp.h; ++dy) {
+            for (int dx = 0; dx < fp.w; ++dx) {
+                free[(y+dy)*bw + (x+dx)] = value;
+            }
+        }
+    }
+
+    void add_rect(const Rect& r) {
+        const Footprint& fp = fps_[r.f];
+        for (int dy = 0; dy < fp.h; ++dy) {
+            for (int dx = 0; dx < fp.w; ++dx) {
+                owner_[(r.y+dy)*W + (r.x+dx)] = rects_.size();
+            }
+        }
+        rects_.push_back(r);
+    }
+
+    std::vector<std::vector<int>> components() const {
+        std::vector<std::vector<int>> result;
+        std::vector<bool> seen(W * W);
+        for (int start = 0; start < W * W; ++start) {
+            if (!todo_[start] || seen[start]) continue;
+            std::vector<int> cells = {start};
+            seen[start] = true;
+            for (size_t i = 0; i < cells.size(); ++i) {
+                int x = cells[i] % W, y = cells[i] / W;
+                int neighbors[4][2] = {{x-1, y}, {x+1, y}, {x, y-1}, {x, y+1}};
+                for (auto& n : neighbors) {
+                    if (0 <= n[0] && n[0] < W && 0 <= n[1] && n[1] < W) {
+                        int c = n[1]*W + n[0];
+                        if (todo_[c] && !seen[c]) {
+                            seen[c] = true;
+                            cells.push_back(c);
+                        }
+                    }
+                }
+            }
+            result.push_back(std::move(cells));
         }
-        std::sort(to_remove.begin(), to_remove.end(), std::greater<int>());
-        for (int i : to_remove) {
-            v.erase(v.begin() + i);
+        return result;
+    }
+
+    // Re-solve the rectangles lying entirely within these cells exactly.
+    // Return true if that saved at least one rectangle.
+    bool improve(const std::vector<int>& cells) {
+        if (cells.empty()) return false;
+        int x0 = W, y0 = W, x1 = 0, y1 = 0;
+        for (int c : cells) {
+            x0 = std::min(x0, c % W); x1 = std::max(x1, c % W + 1);
+            y0 = std::min(y0, c / W); y1 = std::max(y1, c / W + 1);
+        }
+        std::vector<int> inside;
+        for (int c : cells) {
+            int i = owner_[c];
+            const Rect& r = rects_[i];
+            const Footprint& fp = fps_[r.f];
+            if (r.x == c % W && r.y == c / W && x0 <= r.x && r.x + fp.w <= x1 && y0 <= r.y && r.y + fp.h <= y1) {
+                inside.push_back(i);
+            }
+        }
+        if (inside.size() <= 1) return false;
+        bw_ = x1 - x0;
+        bh_ = y1 - y0;
+        free_.assign(bw_ * bh_, false);
+        int ncells = 0;
+        for (int i : inside) {
+            const Rect& r = rects_[i];
+            place(free_, bw_, r.x - x0, r.y - y0, r.f, true);
+            ncells += fps_[r.f].w * fps_[r.f].h;
+        }
+        best_ = inside.size();
+        best_rects_.clear();
+        path_.clear();
+        nodes_ = 0;
+        search(0, ncells);
+        if (best_rects_.empty()) return false;
+        for (int i : inside) {
+            rects_[i].f = -1;
+        }
+        for (const Rect& r : best_rects_) {
+            add_rect(Rect{r.x + x0, r.y + y0, r.f});
         }
         return true;
     }
+
+    void search(int pos, int remaining) {
+        while (pos < bw_ * bh_ && !free_[pos]) ++pos;
+        if (pos == bw_ * bh_) {
+            best_ = path_.size();
+            best_rects_ = path_;
+            return;
+        }
+        int largest = fps_[0].w * fps_[0].h;
+        if (int(path_.size()) + (remaining + largest - 1) / largest >= best_) return;
+        if (++nodes_ > NODE_LIMIT) return;
+        int x = pos % bw_, y = pos / bw_;
+        for (int f = 0; f < int(fps_.size()); ++f) {
+            if (fits(free_, bw_, bh_, x, y, f)) {
+                place(free_, bw_, x, y, f, false);
+                path_.push_back(Rect{x, y, f});
+                search(pos + 1, remaining - fps_[f].w * fps_[f].h);
+                path_.pop_back();
+                place(free_, bw_, x, y, f, true);
+            }
+        }
+    }
+
+    std::vector<Footprint> fps_;
+    std::vector<bool> todo_;
+    std::vector<Rect> rects_;  // f == -1 if since replaced
+    std::vector<int> owner_;   // index into rects_ of each covered cell
+    // State for search()
+    int bw_, bh_, best_;
+    long nodes_;
+    std::vector<bool> free_;
+    std::vector<Rect> path_, best_rects_;
 };
 
+std::vector<Placement> pack_plate_course(const Occupancy& grid, int z0)
+{
+    const int W = LayerPacker::W;
+    std::vector<Placement> out;
+    std::vector<bool> todo(W * W);
+    if (z0 + 3 <= SIDE*5) {
+        for (int y = 0; y < W; ++y) {
+            for (int x = 0; x < W; ++x) {
+                todo[y*W + x] = (grid.at(Lego(x,y,z0)) == PLATE && grid.at(Lego(x,y,z0+1)) == PLATE && grid.at(Lego(x,y,z0+2)) == PLATE);
+            }
+        }
+        LayerPacker packer(footprints(plate_pieces, std::size(plate_pieces), 3));
+        for (const LayerPacker::Rect& r : packer.pack(todo)) {
+            out.push_back(Placement{packer.footprint(r.f).piece, Lego(r.x, r.y, z0)});
+        }
+    }
+    const Piece *plate = footprints(plate_pieces, std::size(plate_pieces), 1).back().piece;
+    for (int z = z0; z < std::min(z0 + 3, SIDE*5); ++z) {
+        for (int y = 0; y < W; ++y) {
+            for (int x = 0; x < W; ++x) {
+                if (grid.at(Lego(x,y,z)) == PLATE && !todo[y*W + x]) {
+                    out.push_back(Placement{plate, Lego(x,y,z)});
+                }
+            }
+        }
+    }
+    return out;
+}
+
+std::vector<Placement> pack_tile_layer(const Occupancy& grid, int z)
+{
+    const int W = LayerPacker::W;
+    std::vector<Placement> out;
+    std::vector<bool> todo(W * W);
+    for (int y = 0; y < W; ++y) {
+        for (int x = 0; x < W; ++x) {
+            todo[y*W + x] = (grid.at(Lego(x,y,z)) == TILE);
+        }
+    }
+    LayerPacker packer(footprints(tile_pieces, std::size(tile_pieces), 1));
+    for (const LayerPacker::Rect& r : packer.pack(todo)) {
+        out.push_back(Placement{packer.footprint(r.f).piece, Lego(r.x, r.y, z)});
+    }
+    return out;
+}
+
+std::vector<Placement> pack_optimally(const Occupancy& grid)
+{
+    // Jobs 0..ncourses-1 are plate courses; the rest are tile layers.
+    const int ncourses = (SIDE*5 + 2) / 3;
+    const int njobs = ncourses + SIDE*5;
+    std::vector<std::vector<Placement>> layers(njobs);
+    std::atomic<int> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&]() {
+            for (int i; (i = next++) < njobs; ) {
+                if (i < ncourses) {
+                    layers[i] = pack_plate_course(grid, 3*i);
+                } else {
+                    layers[i] = pack_tile_layer(grid, i - ncourses);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+    std::vector<Placement> out;
+    for (const std::vector<Placement>& layer : layers) {
+        for (const Placement& pl : layer) {
+            print_placement(pl);
+            out.push_back(pl);
+        }
+    }
+    return out;
+}
+
+void report_counts(const std::vector<Placement>& placements)
+{
+    std::map<std::string, int> counts;
+    for (const Placement& pl : placements) {
+        counts[pl.piece->filename_] += 1;
+    }
+    for (const auto& kv : counts) {
+        fprintf(stderr, "%10s: %d\n", kv.first.c_str(), kv.second);
+    }
+    fprintf(stderr, "%10s: %d\n", "total", int(placements.size()));
+}
+
 int main()
 {
+    static char outbuf[1 << 16];
+    setvbuf(stdout, outbuf, _IOFBF, sizeof outbuf);
     printf("0 STEP\n");
 
+    Occupancy grid;
+#ifndef OPTIMAL
     std::vector<Lego> all_plates;
     std::vector<Lego> all_tiles;
+#endif
+    std::vector<bool> solid(SIDE*2 * SIDE*2);
+    std::vector<bool> solid_above(SIDE*2 * SIDE*2);
+    for (T y = 0; y < SIDE*2; ++y) {
+        for (T x = 0; x < SIDE*2; ++x) {
+            solid[y*SIDE*2 + x] = is_solid_plate(x, y, 0);
+        }
+    }
     for (T z = 0; z < SIDE*5; ++z) {
         for (T y = 0; y < SIDE*2; ++y) {
             for (T x = 0; x < SIDE*2; ++x) {
-                if (is_solid_plate(x, y, z)) {
-                    if (z == SIDE*5 - 1 || !is_solid_plate(x, y, z+1)) {
-                        all_tiles.emplace_back(x,y,z);
-                    } else {
-                        all_plates.emplace_back(x,y,z);
-                    }
+                solid_above[y*SIDE*2 + x] = (z+1 < SIDE*5) && is_solid_plate(x, y, z+1);
+            }
+        }
+        for (T y = 0; y < SIDE*2; ++y) {
+            for (T x = 0; x < SIDE*2; ++x) {
+                if (solid[y*SIDE*2 + x]) {
+                    bool is_tile = !solid_above[y*SIDE*2 + x];
+                    grid.set(Lego(x,y,z), is_tile ? TILE : PLATE);
+#ifndef OPTIMAL
+                    (is_tile ? all_tiles : all_plates).emplace_back(x,y,z);
+#endif
                 }
             }
         }
+        std::swap(solid, solid_above);
     }
+
+#ifdef OPTIMAL
+    std::vector<Placement> placements = pack_optimally(grid);
+#else
     std::mt19937 g;
     std::shuffle(all_plates.begin(), all_plates.end(), g);
     std::shuffle(all_tiles.begin(), all_tiles.end(), g);
     std::partition(all_plates.begin(), all_plates.end(), [](const Lego& g){ return g.z % 3 != 0; });
 
-    if (true) {
-        const Piece poss[] = {
-            Piece{ "3001.dat",  +30, +10, -24, {
-                Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}, Lego{1,0,0}, Lego{1,0,1}, Lego{1,0,2},
-                Lego{0,1,0}, Lego{0,1,1}, Lego{0,1,2}, Lego{1,1,0}, Lego{1,1,1}, Lego{1,1,2},
-                Lego{2,0,0}, Lego{2,0,1}, Lego{2,0,2}, Lego{3,0,0}, Lego{3,0,1}, Lego{3,0,2},
-                Lego{2,1,0}, Lego{2,1,1}, Lego{2,1,2}, Lego{3,1,0}, Lego{3,1,1}, Lego{3,1,2},
-            } },
-            Piece{ "6223.dat",  +10, +10, -24, {Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}, Lego{1,0,0}, Lego{1,0,1}, Lego{1,0,2}, Lego{0,1,0}, Lego{0,1,1}, Lego{0,1,2}, Lego{1,1,0}, Lego{1,1,1}, Lego{1,1,2}} },
-            Piece{ "3004.dat", +10,  +0, -24, {Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}, Lego{1,0,0}, Lego{1,0,1}, Lego{1,0,2}} },
-            Piece{ "30071.dat",  +0,  +0, -24, {Lego{0,0,0}, Lego{0,0,1}, Lego{0,0,2}} },
-            Piece{ "30008.dat",  +0,  +0,  -8, {Lego{0,0,0}} },
-        };
-        while (!all_plates.empty()) {
-            Lego mainguy = all_plates.back();
-            for (const Piece& p : poss) {
-                if (p.doit(mainguy, all_plates)) {
-                    printf("1 7 %d %d %d 1 0 0 0 1 0 0 0 1 %s\n", mainguy.x*20 + p.x_, mainguy.z*-8 + p.z_, mainguy.y*20 + p.y_, p.filename_);
-                    break;
-                }
-            }
-        }
-    }
-
-    if (true) {
-        const Piece poss[] = {
-            Piece{ "63327.dat", +10, +10,  -8, {Lego{0,0,0}, Lego{1,0,0}, Lego{0,1,0}, Lego{1,1,0}} },
-            Piece{ "63864.dat", +20,  +0,  -8, {Lego{0,0,0}, Lego{1,0,0}, Lego{2,0,0}} },
-            Piece{ "30070.dat", +10,  +0,  -8, {Lego{0,0,0}, Lego{1,0,0}} },
-            Piece{ "30039.dat",  +0,  +0,  -8, {Lego{0,0,0}} },
-        };
-        while (!all_tiles.empty()) {
-            Lego mainguy = all_tiles.back();
-            for (const Piece& p : poss) {
-                if (p.doit(mainguy, all_tiles)) {
-                    printf("1 7 %d %d %d 1 0 0 0 1 0 0 0 1 %s\n", mainguy.x*20 + p.x_, mainguy.z*-8 + p.z_, mainguy.y*20 + p.y_, p.filename_);
-                    break;
-                }
-            }
-        }
-    }
+    std::vector<Placement> placements;
+    pack(all_plates, grid, PLATE, plate_pieces, std::size(plate_pieces), placements);
+    pack(all_tiles, grid, TILE, tile_pieces, std::size(tile_pieces), placements);
+#endif
+    fflush(stdout);
+    report_counts(placements);
 }
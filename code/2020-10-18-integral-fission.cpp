@@ -1,6 +1,9 @@
-// Compile with "g++ -std=c++17 -O2 integral-fission.cpp"
+// Compile with "g++ -std=c++17 -O2 -pthread integral-fission.cpp"
 // Run with "./a.out"
 //
+// Add -DTHREADS=8 to factorize and build trees on 8 threads at once.
+// The output is the same either way.
+//
 // The program will run forever until you Ctrl+C it, producing terms
 // to standard output in the form "index term tree", one per line.
 // You can pipe it through `cut -d ' ' -f 2` to extract just the terms.
@@ -13,256 +16,384 @@
 // Newly found terms will be appended to the file.
 // If the specified file doesn't exist, it will be created.
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
-#include <queue>
 #include <numeric>
+#include <thread>
 #include <utility>
 #include <vector>
 
 using Integer = long long;  // to compute term 29729, change this to "long long"
 
-class sieverator {
+// A segmented sieve of Eratosthenes on a 2*3*5 wheel. Each byte of a segment
+// stands for 30 consecutive integers, one bit per residue coprime to 30;
+// a segment is sized to fit in L2 cache. For each sieving prime p and each
+// wheel residue r of the cofactor, the multiples p*(30k+r) all land on the same
+// bit, p bytes apart. Segments are independent, so we sieve several at once.
+
+#ifndef L2_CACHE_BYTES
+ #define L2_CACHE_BYTES (256 * 1024)
+#endif
+
+class segmented_sieve {
+    static constexpr int residues_[8] = {1, 7, 11, 13, 17, 19, 23, 29};
+
+    static int bit_of_residue(int r) {
+        for (int i=0; i < 8; ++i) {
+            if (residues_[i] == r) return i;
+        }
+        return -1;
+    }
+
 public:
-    explicit sieverator() {
-        m_pq.emplace(25, 10, 30);
-        m_current = 5;
-        m_d = 4;
-    }
-    sieverator(const sieverator&) = delete;
-    sieverator& operator=(const sieverator&) = delete;
-
-    Integer next() {
-        while (true) {
-            m_d = 6 - m_d;
-            m_current += m_d;
-            while (m_current > m_pq.top().next_crossed_off_value) {
-                auto x = m_pq.top();
-                m_pq.reemplace_top(x.next_crossed_off_value + x.delta1, x.delta2 - x.delta1, x.delta2);
-            }
-            if (m_current == m_pq.top().next_crossed_off_value) {
-                while (m_current == m_pq.top().next_crossed_off_value) {
-                    auto x = m_pq.top();
-                    m_pq.reemplace_top(x.next_crossed_off_value + x.delta1, x.delta2 - x.delta1, x.delta2);
-                }
-            } else {
-                // Found a new prime. Start crossing off multiples of it, and return.
-                if (m_current < std::numeric_limits<Integer>::max() / m_current) {
-                    m_pq.emplace(m_current * m_current, ((m_current % 3 == 1) ? 4 : 2) * m_current, 6 * m_current);
-                }
-                return m_current;
+    static constexpr Integer segment_bytes = L2_CACHE_BYTES;
+    static constexpr Integer segment_span = 30 * segment_bytes;
+
+    explicit segmented_sieve(Integer limit) : limit_(limit) {
+        Integer root = std::sqrt(double(limit)) + 1;
+        std::vector<bool> composite(root + 1);
+        for (Integer p = 7; p <= root; ++p) {
+            if (composite[p] || p % 2 == 0 || p % 3 == 0 || p % 5 == 0) continue;
+            sieving_primes_.push_back(p);
+            for (Integer m = p * p; m <= root; m += p) {
+                composite[m] = true;
             }
         }
     }
 
-    std::vector<Integer> extract_primes(Integer n) const {
-        std::vector<Integer> result;
-        result.reserve(m_pq.size() + 2);
-        result.push_back(2);
-        result.push_back(3);
-        for (const auto& pair : m_pq.vector()) {
-            result.push_back(pair.delta2 / 6);
+    Integer limit() const { return limit_; }
+
+    // Append to `out`, in order, every prime in [lo, min(lo + segment_span, limit)).
+    // `lo` must be a multiple of 30.
+    void sieve_segment(Integer lo, std::vector<Integer>& out) const {
+        assert(lo % 30 == 0);
+        Integer hi = std::min(lo + segment_span, limit_);
+        if (lo == 0) {
+            for (Integer p : {2, 3, 5}) {
+                if (p < hi) out.push_back(p);
+            }
+        }
+        Integer nbytes = (hi - lo + 29) / 30;
+        std::vector<unsigned char> seg(nbytes, 0);
+        if (lo == 0) {
+            seg[0] |= 1;  // 1 is not a prime
+        }
+        for (Integer p : sieving_primes_) {
+            if (p * p >= hi) break;
+            Integer mlo = std::max(p, (lo + p - 1) / p);
+            for (int r : residues_) {
+                Integer m = mlo + ((r - mlo % 30) % 30 + 30) % 30;
+                Integer v = p * m;
+                unsigned char mask = 1 << bit_of_residue(v % 30);
+                for (Integer b = (v - lo) / 30; b < nbytes; b += p) {
+                    seg[b] |= mask;
+                }
+            }
+        }
+        for (Integer b = 0; b < nbytes; ++b) {
+            unsigned char bits = ~seg[b];
+            while (bits != 0) {
+                int i = __builtin_ctz(bits);
+                bits &= bits - 1;
+                Integer v = lo + 30 * b + residues_[i];
+                if (v >= hi) break;
+                out.push_back(v);
+            }
         }
-        std::sort(result.begin(), result.end());
-        result.erase(std::lower_bound(result.begin(), result.end(), n), result.end());
-        return result;
     }
 
 private:
-    template<class T, class Container, class Compare>
-    class PQ : public std::priority_queue<T, Container, Compare>
-    {
-        int swap_elements(int i, int j) {
-            using std::swap;
-            swap(this->c[i], this->c[j]);
-            return j;
-        }
-
-        void sift_down() {
-            int i = 0;
-            int n = this->size();
-            while (2*i+1 < n) {
-                int lx = 2*i+1;
-                int rx = 2*i+2;
-                bool i_lessthan_lx = (lx < n && this->comp(this->c[i], this->c[lx]));
-                bool i_lessthan_rx = (rx < n && this->comp(this->c[i], this->c[rx]));
-                if (i_lessthan_lx && i_lessthan_rx) {
-                    i = this->swap_elements(i, (this->comp(this->c[lx], this->c[rx]) ? rx : lx));
-                } else if (i_lessthan_lx) {
-                    i = this->swap_elements(i, lx);
-                } else if (i_lessthan_rx) {
-                    i = this->swap_elements(i, rx);
-                } else {
-                    break;
-                }
+    Integer limit_;
+    std::vector<Integer> sieving_primes_;  // the primes from 7 up to sqrt(limit)
+};
+
+#ifndef FACTOR_WINDOW
+ #define FACTOR_WINDOW (1 << 16)
+#endif
+
+// The prime factorizations of every integer in [lo_, hi_), stored flat:
+// the factors of lo_+i are factors_[offset_[i] .. offset_[i+1]), in increasing order.
+class FactorWindow {
+    Integer lo_ = 0;
+    Integer hi_ = 0;
+    std::vector<int> offset_;
+    std::vector<Integer> factors_;
+    std::vector<Integer> rem_;
+    std::vector<std::pair<int, Integer>> found_;
+
+    // Factorize the next window of integers starting at `lo`, by a segmented sieve:
+    // divide each known prime p <= sqrt(hi) out of its multiples in the window; whatever
+    // cofactor remains is 1 or a single large prime.
+    void slide_to(Integer lo, const std::vector<Integer>& primes, Integer known_below) {
+        Integer hi = lo + FACTOR_WINDOW;
+        if (known_below < (Integer(1) << 31)) {
+            hi = std::min(hi, known_below * known_below);
+        }
+        assert(lo < hi);
+        int w = hi - lo;
+        rem_.resize(w);
+        std::iota(rem_.begin(), rem_.end(), lo);
+        found_.clear();
+        for (Integer p : primes) {
+            if (p * p >= hi) break;
+            for (Integer m = (lo + p - 1) / p * p; m < hi; m += p) {
+                int i = m - lo;
+                do {
+                    rem_[i] /= p;
+                    found_.emplace_back(i, p);
+                } while (rem_[i] % p == 0);
             }
         }
-    public:
-        Container& vector() { return this->c; }
-        const Container& vector() const { return this->c; }
-
-        template<class... Args>
-        void reemplace_top(Args&&... args) {
-            this->c.front() = T(static_cast<Args&&>(args)...);
-            this->sift_down();
+        for (int i = 0; i < w; ++i) {
+            if (rem_[i] != 1) {
+                found_.emplace_back(i, rem_[i]);
+            }
         }
-    };
-
-    struct pair {
-        Integer next_crossed_off_value;
-        Integer delta1;
-        Integer delta2;
-        explicit pair(Integer a, Integer b, Integer c) : next_crossed_off_value(a), delta1(b), delta2(c) {}
-        bool operator<(const pair& rhs) const {
-            return next_crossed_off_value < rhs.next_crossed_off_value;
+        // Counting-sort the (index, prime) pairs by index, keeping each index's primes in order.
+        offset_.assign(w + 1, 0);
+        for (const auto& [i, p] : found_) {
+            offset_[i + 1] += 1;
         }
-        bool operator>(const pair& rhs) const { return rhs < *this; }
-    };
-    template<class T> using min_heap = PQ<T, std::vector<T>, std::greater<>>;
+        std::partial_sum(offset_.begin(), offset_.end(), offset_.begin());
+        factors_.resize(found_.size());
+        std::vector<int> next(offset_.begin(), offset_.end() - 1);
+        for (const auto& [i, p] : found_) {
+            factors_[next[i]++] = p;
+        }
+        lo_ = lo;
+        hi_ = hi;
+    }
 
-    min_heap<pair> m_pq;
-    Integer m_current;
-    int m_d;
+public:
+    // Successive calls should pass increasing `n`. Every prime below `known_below`
+    // must be in `primes`, and `n` must be less than known_below squared.
+    std::vector<Integer> prime_factorize(Integer n, const std::vector<Integer>& primes, Integer known_below, std::vector<Integer> factors) {
+        if (n < lo_ || n >= hi_) {
+            slide_to(n, primes, known_below);
+        }
+        int i = n - lo_;
+        factors.assign(factors_.begin() + offset_[i], factors_.begin() + offset_[i + 1]);
+        return factors;
+    }
 };
 
 class Primes {
     std::vector<Integer> all_primes_;
+    FactorWindow window_;
 
 public:
     void build_sieve(Integer limit) {
         if (limit <= 2) return;
-        sieverator sieve;
-        Integer next_percentage_mark = 0;
-        while (true) {
-             Integer p = sieve.next();
-             if (p > next_percentage_mark) {
-                 std::cerr << "Building prime sieve (" << int((100.0 * p) / limit) << "%)...\r" << std::flush;
-                 next_percentage_mark += limit / 100;
+        segmented_sieve sieve(limit);
+        int nthreads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::vector<Integer>> primes_of_thread(nthreads);
+        all_primes_.clear();
+        for (Integer lo = 0; lo < limit; lo += nthreads * sieve.segment_span) {
+            std::cerr << "Building prime sieve (" << int((100.0 * lo) / limit) << "%)...\r" << std::flush;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < nthreads; ++t) {
+                primes_of_thread[t].clear();
+                Integer seglo = lo + t * sieve.segment_span;
+                if (seglo < limit) {
+                    threads.emplace_back([&, t, seglo]() {
+                        sieve.sieve_segment(seglo, primes_of_thread[t]);
+                    });
+                }
+            }
+            for (auto& th : threads) {
+                th.join();
+            }
+            for (const auto& primes : primes_of_thread) {
+                all_primes_.insert(all_primes_.end(), primes.begin(), primes.end());
             }
-            if (p >= limit) break;
         }
+        std::cerr << "Building prime sieve (100%)...\r" << std::flush;
         std::cerr << "\nDone building sieve\n";
-        all_primes_ = sieve.extract_primes(limit);
     }
     void add_known_prime(Integer n) {
         assert((all_primes_.empty() && n == 2) || (n > all_primes_.back()));
         all_primes_.push_back(n);
     }
-    std::vector<Integer> prime_factorize(Integer n, std::vector<Integer> factors) const {
-        factors.clear();
-        for (Integer p : all_primes_) {
-            while (n % p == 0) {
-                factors.push_back(p);
-                n /= p;
-            }
-            if (n == 1) return factors;
-            if (p * p > n) break;
-        }
-        factors.push_back(n);
-        return factors;
+    const std::vector<Integer>& known_primes() const {
+        return all_primes_;
+    }
+    // Successive calls should pass successive `n`, and every prime below `n`
+    // must already be known (via build_sieve or add_known_prime).
+    std::vector<Integer> prime_factorize(Integer n, std::vector<Integer> factors) {
+        return window_.prime_factorize(n, all_primes_, n, std::move(factors));
     }
 };
 Primes g_primes;
 
-auto factorize(Integer n) -> std::pair<Integer, Integer>
+// Given the prime factorization `pf` of `n` (in increasing order), find the divisor
+// pair (f1, f2) with f1 <= f2 and f1 as large as possible, by searching the divisors
+// of `n` no greater than sqrt(n). Split `pf` into the factorizations of f1 and f2.
+auto factorize(Integer n, const std::vector<Integer>& pf, std::vector<Integer>& pf1, std::vector<Integer>& pf2) -> std::pair<Integer, Integer>
 {
-    if (n == 2 || n == 3 || n == 5) {
-        return {1, n};
+    struct PrimePower { Integer p; int e; };
+    PrimePower groups[64];
+    int ng = 0;
+    for (Integer p : pf) {
+        if (ng != 0 && groups[ng-1].p == p) {
+            groups[ng-1].e += 1;
+        } else {
+            groups[ng++] = {p, 1};
+        }
     }
-    for (Integer f1 = std::sqrt(double(n)); true; --f1) {
-        Integer f2 = n / f1;
-        if (f1 * f2 == n) {
-            return {f1, f2};
+    int chosen[64] = {};
+    int best_chosen[64] = {};
+    Integer best = 1;
+    auto search = [&](auto& self, int g, Integer d) -> void {
+        if (g == ng) {
+            if (d > best) {
+                best = d;
+                std::copy(chosen, chosen + ng, best_chosen);
+            }
+            return;
         }
+        for (int k = 0; true; ++k) {
+            chosen[g] = k;
+            self(self, g+1, d);
+            if (k == groups[g].e) break;
+            d *= groups[g].p;
+            if (d > n / d) break;
+        }
+        chosen[g] = 0;
+    };
+    search(search, 0, 1);
+
+    pf1.clear();
+    pf2.clear();
+    for (int g = 0; g < ng; ++g) {
+        pf1.insert(pf1.end(), best_chosen[g], groups[g].p);
+        pf2.insert(pf2.end(), groups[g].e - best_chosen[g], groups[g].p);
     }
+    return {best, n / best};
 }
 
+// A Tree is a flat array of nodes with explicit child indices; nodes_[0] is the root.
+// Its Shape is the preorder sequence of "is this node internal?" bits, which
+// identifies the (ordered) shape exactly in 2*leafcount-1 bits. A single Tree can
+// be rebuilt in place with `assign`, reusing its storage from candidate to candidate.
 class Tree {
+public:
+    using Shape = std::vector<bool>;
+
+private:
+    struct Node {
+        Integer factor;
+        int left;   // -1 for a leaf
+        int right;  // -1 for a leaf
+    };
+
     int leafcount_ = 0;
-    std::vector<bool> occupied_;
-    std::vector<Integer> factors_;
+    std::vector<Node> nodes_;
+    Shape shape_;
 
-    bool is_leaf(int idx) const {
-        if (!occupied_[idx]) return false;
-        if (2*idx+1 >= occupied_.size()) return true;
-        return !occupied_[2*idx+1];
+    bool is_leaf(int ix) const {
+        return nodes_[ix].left < 0;
+    }
+
+    int new_node(Integer factor) {
+        nodes_.push_back(Node{factor, -1, -1});
+        return nodes_.size() - 1;
+    }
+
+    void compute_shape(int ix) {
+        shape_.push_back(!is_leaf(ix));
+        if (!is_leaf(ix)) {
+            compute_shape(nodes_[ix].left);
+            compute_shape(nodes_[ix].right);
+        }
     }
 
     bool subtree_iso(int lx, const Tree& rhs, int rx) const {
-        if (occupied_[lx] != rhs.occupied_[rx]) return false;
         if (is_leaf(lx)) {
             return rhs.is_leaf(rx);
         } else {
             if (rhs.is_leaf(rx)) return false;
-            return (subtree_iso(2*lx+1, rhs, 2*rx+1) && subtree_iso(2*lx+2, rhs, 2*rx+2))
-                || (subtree_iso(2*lx+1, rhs, 2*rx+2) && subtree_iso(2*lx+2, rhs, 2*rx+1));
+            const Node& l = nodes_[lx];
+            const Node& r = rhs.nodes_[rx];
+            return (subtree_iso(l.left, rhs, r.left) && subtree_iso(l.right, rhs, r.right))
+                || (subtree_iso(l.left, rhs, r.right) && subtree_iso(l.right, rhs, r.left));
         }
     }
 
     void subtree_print(std::ostream& os, int ix) const {
         if (is_leaf(ix)) {
-            os << factors_[ix];
+            os << nodes_[ix].factor;
         } else {
             os << '(';
-            this->subtree_print(os, 2*ix+1);
+            this->subtree_print(os, nodes_[ix].left);
             os << ',';
-            this->subtree_print(os, 2*ix+2);
+            this->subtree_print(os, nodes_[ix].right);
             os << ')';
         }
     }
 
-    void subtree_scan(std::istream& is, int ix) {
+    int subtree_scan(std::istream& is) {
         while (std::isspace(is.peek())) {
             is.get();
         }
+        int ix = new_node(0);
         if (is.peek() == '(') {
             is.get();
-            subtree_scan(is, 2*ix+1);
+            int l = subtree_scan(is);
             is.get();  // ','
-            subtree_scan(is, 2*ix+2);
+            int r = subtree_scan(is);
             is.get();  // ')'
-            occupied_[ix] = true;
-            factors_[ix] = factors_[2*ix+1] * factors_[2*ix+2];
+            nodes_[ix].left = l;
+            nodes_[ix].right = r;
+            nodes_[ix].factor = nodes_[l].factor * nodes_[r].factor;
         } else {
-            if (ix >= occupied_.size()) {
-                occupied_.resize(ix+1);
-                factors_.resize(ix+1);
-            }
-            occupied_[ix] = true;
-            is >> factors_[ix];
+            is >> nodes_[ix].factor;
             leafcount_ += 1;
         }
+        return ix;
     }
 
 public:
-    using Shape = std::vector<bool>;
+    explicit Tree() = default;
 
-    explicit Tree(Integer n) {
-        occupied_.reserve(40);
-        occupied_.push_back(true);
-        factors_.reserve(40);
-        factors_.push_back(n);
-        for (int i=0; i < factors_.size(); ++i) {
-            if (occupied_[i]) {
-                auto [f1, f2] = factorize(factors_[i]);
-                if (f1 != 1) {
-                    occupied_.resize(2*i+3);
-                    factors_.resize(2*i+3);
-                    occupied_[2*i+1] = true;
-                    occupied_[2*i+2] = true;
-                    factors_[2*i+1] = f1;
-                    factors_[2*i+2] = f2;
-                } else {
-                    leafcount_ += 1;
-                }
+    explicit Tree(Integer n, const std::vector<Integer>& prime_factors) {
+        this->assign(n, prime_factors);
+    }
+
+    void assign(Integer n, const std::vector<Integer>& prime_factors) {
+        // The prime factorization of each node, indexed like nodes_.
+        // It's kept around between calls so that the inner vectors keep their capacity.
+        static thread_local std::vector<std::vector<Integer>> pfs;
+
+        nodes_.clear();
+        leafcount_ = 0;
+        new_node(n);
+        if (pfs.empty()) {
+            pfs.resize(1);
+        }
+        pfs[0].assign(prime_factors.begin(), prime_factors.end());
+        for (int i=0; i < nodes_.size(); ++i) {
+            int j = nodes_.size();
+            if (pfs.size() < j + 2) {
+                pfs.resize(j + 2);
+            }
+            auto [f1, f2] = factorize(nodes_[i].factor, pfs[i], pfs[j], pfs[j+1]);
+            if (f1 != 1) {
+                nodes_[i].left = new_node(f1);
+                nodes_[i].right = new_node(f2);
+            } else {
+                leafcount_ += 1;
             }
         }
+        shape_.clear();
+        compute_shape(0);
     }
 
     Integer root() const {
-        return factors_[0];
+        return nodes_[0].factor;
     }
 
     int leafcount() const {
@@ -271,25 +402,28 @@ public:
 
     template<class F>
     void for_each_prime_leaf(F f) const {
-        for (int i=0; i < occupied_.size(); ++i) {
+        for (int i=0; i < nodes_.size(); ++i) {
             if (this->is_leaf(i)) {
-                f(factors_[i]);
+                f(nodes_[i].factor);
             }
         }
     }
 
     const Shape& shape() const {
-        return occupied_;
+        return shape_;
     }
 
     bool identical_shape(const Tree& rhs) const {
-        return occupied_ == rhs.occupied_;
+        return shape_ == rhs.shape_;
     }
 
     bool isomorphic_shape(const Tree& rhs) const {
         if (leafcount_ != rhs.leafcount_) {
             return false;
         }
+        if (shape_ == rhs.shape_) {
+            return true;
+        }
         return subtree_iso(0, rhs, 0);
     }
 
@@ -299,14 +433,87 @@ public:
     }
 
     friend std::istream& operator>>(std::istream& is, Tree& rhs) {
-        rhs.occupied_.clear();
-        rhs.factors_.clear();
+        rhs.nodes_.clear();
         rhs.leafcount_ = 0;
-        rhs.subtree_scan(is, 0);
+        rhs.subtree_scan(is);
+        rhs.shape_.clear();
+        rhs.compute_shape(0);
         return is;
     }
 };
 
+// An open-addressing hash set of tree shapes. Each shape is packed into 64-bit
+// words in a single arena; a slot holds the shape's 64-bit hash and its location
+// in the arena. On a hash match we compare the packed bits, so collisions are harmless.
+class ShapeSet {
+    struct Slot {
+        uint64_t hash;
+        uint32_t offset;  // in words, into arena_
+        uint32_t nbits;   // 0 means the slot is empty
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<uint64_t> arena_;
+    std::vector<uint64_t> scratch_;
+    size_t size_ = 0;
+
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    void grow() {
+        std::vector<Slot> old = std::move(slots_);
+        slots_.assign(old.empty() ? 16 : 2 * old.size(), Slot{0, 0, 0});
+        size_t mask = slots_.size() - 1;
+        for (const Slot& s : old) {
+            if (s.nbits != 0) {
+                size_t i = s.hash & mask;
+                while (slots_[i].nbits != 0) i = (i + 1) & mask;
+                slots_[i] = s;
+            }
+        }
+    }
+
+public:
+    size_t size() const { return size_; }
+
+    // Returns true if the shape was newly inserted, false if it was already present.
+    bool insert(const Tree::Shape& shape) {
+        uint32_t nbits = shape.size();
+        size_t nwords = (nbits + 63) / 64;
+        scratch_.assign(nwords, 0);
+        for (uint32_t b = 0; b < nbits; ++b) {
+            if (shape[b]) scratch_[b / 64] |= uint64_t(1) << (b % 64);
+        }
+        uint64_t hash = mix(nbits);
+        for (uint64_t w : scratch_) {
+            hash = mix(hash ^ w);
+        }
+
+        if (2 * (size_ + 1) > slots_.size()) {
+            grow();
+        }
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask; true; i = (i + 1) & mask) {
+            Slot& s = slots_[i];
+            if (s.nbits == 0) {
+                s = Slot{hash, uint32_t(arena_.size()), nbits};
+                arena_.insert(arena_.end(), scratch_.begin(), scratch_.end());
+                size_ += 1;
+                return true;
+            }
+            if (s.hash == hash && s.nbits == nbits && std::equal(scratch_.begin(), scratch_.end(), arena_.begin() + s.offset)) {
+                return false;
+            }
+        }
+    }
+};
+
 class NoveltySeeker {
 public:
     bool might_be_novel_with_leafcount(int lc) const {
@@ -317,11 +524,9 @@ public:
     bool add_tree_if_novel(const Tree& tree) {
         int lc = tree.leafcount();
         assert(lc < std::size(seen_of_leafcount));
-        auto it = std::lower_bound(seen_of_leafcount[lc].begin(), seen_of_leafcount[lc].end(), tree.shape());
-        if (it != seen_of_leafcount[lc].end() && *it == tree.shape()) {
+        if (!seen_of_leafcount[lc].insert(tree.shape())) {
             return false;
         }
-        seen_of_leafcount[lc].insert(it, tree.shape());
         if (lc < unseen_of_leafcount.size()) {
             assert(unseen_of_leafcount[lc] > 0);
             unseen_of_leafcount[lc] -= 1;
@@ -330,7 +535,7 @@ public:
     }
 
 private:
-    std::vector<Tree::Shape> seen_of_leafcount[64];  // this is good up to 2^64; kept sorted
+    ShapeSet seen_of_leafcount[64];  // this is good up to 2^64
     std::vector<int> unseen_of_leafcount = {
         0, 1, 1, 2, // two distinct trees with 3 factors
         5, 14, 42, 132, 429, 1430, 4862,  // with 10 factors
@@ -339,6 +544,112 @@ private:
     };
 };
 
+void record_term(int& idx, Integer n, const Tree& tree, std::ofstream& outfile) {
+    if (outfile) {
+        outfile << idx << " " << n << " " << tree << std::endl;
+    }
+    std::cout << idx << " " << n << " " << tree << std::endl;
+    ++idx;
+}
+
+void scan_serially(int idx, Integer n, NoveltySeeker& novelty, std::ofstream& outfile) {
+    std::vector<Integer> prime_factors;
+    Tree tree;
+    for ( ; true; ++n) {
+        prime_factors = g_primes.prime_factorize(n, std::move(prime_factors));
+        int lc = prime_factors.size();
+        assert(lc >= 1);
+        if (lc == 1) {
+            g_primes.add_known_prime(n);
+        }
+        if (novelty.might_be_novel_with_leafcount(lc)) {
+            tree.assign(n, prime_factors);
+            assert(tree.leafcount() == lc);
+            if (novelty.add_tree_if_novel(tree)) {
+                record_term(idx, n, tree, outfile);
+            }
+        }
+    }
+}
+
+// Scan in rounds. In each round, THREADS workers factorize consecutive blocks of
+// FACTOR_WINDOW integers and build the trees of all those that might be novel.
+// Then the main thread commits the blocks in order: it records new primes, and
+// tests each tree against `novelty` exactly as scan_serially would have.
+// Workers only need the primes below sqrt(hi), all of which are known by the
+// start of the round; so early rounds are kept short (hi <= lo*lo).
+
+#ifndef THREADS
+ #define THREADS 1
+#endif
+
+struct ScannedBlock {
+    std::vector<int> leafcounts;    // of each integer in the block
+    std::vector<int> tree_indices;  // into `trees`, or -1 if its tree wasn't built
+    std::vector<Tree> trees;        // reused from round to round
+};
+
+void scan_in_parallel(int idx, Integer n, NoveltySeeker& novelty, std::ofstream& outfile) {
+    std::vector<FactorWindow> windows(THREADS);
+    std::vector<ScannedBlock> blocks(THREADS);
+    for (Integer lo = n; true; ) {
+        Integer hi = lo + Integer(THREADS) * FACTOR_WINDOW;
+        if (lo < (Integer(1) << 31)) {
+            hi = std::min(hi, lo * lo);
+        }
+        Integer block_size = (hi - lo + THREADS - 1) / THREADS;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&, t]() {
+                ScannedBlock& blk = blocks[t];
+                blk.leafcounts.clear();
+                blk.tree_indices.clear();
+                int ntrees = 0;
+                std::vector<Integer> prime_factors;
+                Integer blo = std::min(hi, lo + t * block_size);
+                Integer bhi = std::min(hi, blo + block_size);
+                for (Integer m = blo; m < bhi; ++m) {
+                    prime_factors = windows[t].prime_factorize(m, g_primes.known_primes(), lo, std::move(prime_factors));
+                    int lc = prime_factors.size();
+                    blk.leafcounts.push_back(lc);
+                    if (novelty.might_be_novel_with_leafcount(lc)) {
+                        if (ntrees == blk.trees.size()) {
+                            blk.trees.emplace_back();
+                        }
+                        blk.trees[ntrees].assign(m, prime_factors);
+                        blk.tree_indices.push_back(ntrees++);
+                    } else {
+                        blk.tree_indices.push_back(-1);
+                    }
+                }
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+        Integer m = lo;
+        for (const ScannedBlock& blk : blocks) {
+            for (int i = 0; i < blk.leafcounts.size(); ++i, ++m) {
+                int lc = blk.leafcounts[i];
+                assert(lc >= 1);
+                if (lc == 1) {
+                    g_primes.add_known_prime(m);
+                }
+                if (novelty.might_be_novel_with_leafcount(lc)) {
+                    assert(blk.tree_indices[i] >= 0);
+                    const Tree& tree = blk.trees[blk.tree_indices[i]];
+                    assert(tree.leafcount() == lc);
+                    if (novelty.add_tree_if_novel(tree)) {
+                        record_term(idx, m, tree, outfile);
+                    }
+                }
+            }
+        }
+        assert(m == hi);
+        lo = hi;
+    }
+}
+
 int main(int argc, char **argv) {
     int idx = 1;  // the OEIS sequence starts "1 2 4 8..." but we won't print the "1"
     Integer n = 1;
@@ -349,7 +660,7 @@ int main(int argc, char **argv) {
 
     if (argc == 2) {
         std::ifstream input(argv[1]);
-        auto tree = Tree(2);
+        Tree tree;
         idx = 1;
         n = 1;
         while (input >> idx >> n >> tree) {
@@ -372,24 +683,9 @@ int main(int argc, char **argv) {
         n = 2;
     }
 
-    std::vector<Integer> prime_factors;
-    for ( ; true; ++n) {
-        prime_factors = g_primes.prime_factorize(n, std::move(prime_factors));
-        int lc = prime_factors.size();
-        assert(lc >= 1);
-        if (lc == 1) {
-            g_primes.add_known_prime(n);
-        }
-        if (novelty.might_be_novel_with_leafcount(lc)) {
-            auto tree = Tree(n);
-            assert(tree.leafcount() == lc);
-            if (novelty.add_tree_if_novel(tree)) {
-                if (outfile) {
-                    outfile << idx << " " << n << " " << tree << std::endl;
-                }
-                std::cout << idx << " " << n << " " << tree << std::endl;
-                ++idx;
-            }
-        }
+    if (THREADS > 1) {
+        scan_in_parallel(idx, n, novelty, outfile);
+    } else {
+        scan_serially(idx, n, novelty, outfile);
     }
 }
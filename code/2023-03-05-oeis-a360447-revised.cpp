@@ -12,12 +12,26 @@
 //     using Int = IntN<5>;
 // to
 //     using Int = IntN<6>;
+//
+// Add -DTHREADS=4 -pthread to use the windowed engine, in which all threads first
+// read the next WINDOW values of `a[i]` (and warm the cache lines that each insertion
+// will touch), and then a single committer applies those insertions in order. The two
+// phases do not overlap, so this only pays off where the read-ahead misses dominate;
+// on a single core it is slower than the serial engine. Its output is identical.
+//
+// Add -DSTREAM to write each term to b360447.txt (in OEIS b-file format) as soon as
+// it becomes stable, instead of reprinting the whole stable prefix on every update.
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
+#include <mutex>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
 int elapsed_sec() {
     static auto start = std::chrono::steady_clock::now();
@@ -29,6 +43,14 @@ int elapsed_sec() {
  #error "Set -DMAX=100'000'000 on the command line!"
 #endif
 
+#ifndef THREADS
+ #define THREADS 1
+#endif
+
+#ifndef WINDOW
+ #define WINDOW (1 << 14)
+#endif
+
 template<int Bytes>
 struct IntN {
     IntN() = default;
@@ -113,6 +135,133 @@ void print_final_update(const Int *a, size_t i) {
     }
 }
 
+// In streaming mode we keep a persistent cursor at the last stable term, and
+// only ever advance it. While sum = p+q lies in (i, MAX), a[sum] is exactly the
+// predecessor where `sum` will be inserted; so "can we find a better insertion
+// point" is just "is a[sum] someone other than p". Only at the very end, for sums
+// beyond MAX, do we need to scan; we batch those queries into a single pass.
+
+struct StablePrefix {
+    FILE *out = nullptr;
+    size_t p = 0;      // the last stable term; its successor may not be stable yet
+    size_t count = 0;  // the number of stable terms, a(0) through a(count-1)
+
+    void open(const char *fname) {
+        out = fopen(fname, "w");
+        if (out == nullptr) {
+            printf("Could not open %s for writing\n", fname);
+            exit(1);
+        }
+        emit(0);
+    }
+    void emit(size_t term) {
+        fprintf(out, "%zu %zu\n", count, term);
+        count += 1;
+        p = term;
+    }
+};
+
+static StablePrefix g_stable;
+
+size_t advance_stable_prefix(const Int *a, size_t i) {
+    while (true) {
+        size_t q = a[g_stable.p];
+        size_t sum = g_stable.p + q;
+        if (q != 0 && (sum <= i || (sum < MAX && a[sum] != g_stable.p))) {
+            g_stable.emit(q);
+        } else {
+            fflush(g_stable.out);
+            return sum;
+        }
+    }
+}
+
+size_t stream_update(const Int *a, size_t i) {
+    size_t sum = advance_stable_prefix(a, i);
+    printf("a(%zu)=%zu  (i=%zu, next update at i=%zu, elapsed=%ds)\n", g_stable.count - 1, g_stable.p, i, sum, elapsed_sec());
+    return sum;
+}
+
+// For each of the `n` sorted `sums`, find whether any adjacent pair currently in the list
+// adds up to it with an absolute difference smaller than the corresponding `diffs`.
+void find_better_insertion_points(const Int *a, size_t i, const size_t *sums, const size_t *diffs, size_t n, bool *better) {
+    std::fill(better, better + n, false);
+    for (size_t p = 0; p < i - 1; ++p) {
+        size_t q = a[p];
+        const size_t *it = std::lower_bound(sums, sums + n, p + q);
+        for (; it != sums + n && *it == p + q; ++it) {
+            size_t k = it - sums;
+            if (absdiff(p, q) < diffs[k]) better[k] = true;
+        }
+    }
+}
+
+void stream_final_update(const Int *a, size_t i) {
+    constexpr size_t Batch = 64;
+    advance_stable_prefix(a, i);
+    while (true) {
+        // Gather the next few pairs whose stability depends on sums beyond MAX.
+        size_t terms[Batch + 1];
+        size_t sums[Batch];
+        size_t diffs[Batch];
+        size_t n = 0;
+        terms[0] = g_stable.p;
+        while (n < Batch) {
+            size_t q = a[terms[n]];
+            if (q == 0) break;
+            sums[n] = terms[n] + q;
+            diffs[n] = absdiff(terms[n], q);
+            terms[n+1] = q;
+            n += 1;
+        }
+        size_t sorted_sums[Batch];
+        size_t sorted_diffs[Batch];
+        size_t order[Batch];
+        for (size_t k = 0; k < n; ++k) order[k] = k;
+        std::sort(order, order + n, [&](size_t x, size_t y) { return sums[x] < sums[y]; });
+        for (size_t k = 0; k < n; ++k) {
+            sorted_sums[k] = sums[order[k]];
+            sorted_diffs[k] = diffs[order[k]];
+        }
+        bool sorted_better[Batch];
+        find_better_insertion_points(a, i, sorted_sums, sorted_diffs, n, sorted_better);
+        bool better[Batch];
+        for (size_t k = 0; k < n; ++k) better[order[k]] = sorted_better[k];
+
+        size_t k = 0;
+        while (k < n && (sums[k] <= i || better[k])) {
+            g_stable.emit(terms[k+1]);
+            k += 1;
+        }
+        if (k < n || n < Batch) {
+            fclose(g_stable.out);
+            size_t p = g_stable.p;
+            if (k < n) {
+                printf("a(%zu)=%zu  (i=%zu, next update at i=%zu, elapsed=%ds)\n", g_stable.count - 1, p, i, sums[k], elapsed_sec());
+            } else {
+                // The whole list is stable; its next update is whatever gets appended.
+                printf("a(%zu)=%zu  (i=%zu, elapsed=%ds)\n", g_stable.count - 1, p, i, elapsed_sec());
+            }
+            printf("\nStable terms a(0)-a(%zu) appear in b360447.txt.\n", g_stable.count - 1);
+            printf("As of i=%zu, the list continues with these (not-yet-stable) terms:", i);
+            for (int j=0; j < 10; ++j) {
+                p = a[p];
+                printf(" %zu,", p);
+            }
+            printf("\n\n");
+            return;
+        }
+    }
+}
+
+size_t report_update(const Int *a, size_t i) {
+#ifdef STREAM
+    return stream_update(a, i);
+#else
+    return print_update(a, i);
+#endif
+}
+
 void maybe_map(Int *a, size_t p, size_t q) {
     size_t sum = p + q;
     if (sum >= MAX) return;
@@ -126,6 +275,135 @@ void maybe_map(Int *a, size_t p, size_t q) {
     }
 }
 
+// Insert `i` into the list, given that `p = a[i]` was its predecessor-to-be
+// (or 0, meaning "append at the back"). Returns the predecessor actually used.
+// The only entries of `a` beyond `i` that this can change are a[i+p] and
+// (if `i` wasn't appended) a[i+q] == a[2*i-p].
+
+size_t insert_one(Int *a, size_t i, size_t p, size_t& back, size_t& nextupdate) {
+    if (p == 0) {
+        p = back;
+        // Insert `i` after `p` in the list.
+        assert(a[p] == 0);
+        a[p] = i;
+        assert(a[i] == 0);
+        back = i;
+        maybe_map(a, p, i);
+        return p;
+    } else {
+        Int q = i - p;
+        assert(q == a[p]);
+        // Now insert `i` between `p` and `q` in the list.
+        a[i] = a[p];
+        a[p] = i;
+        maybe_map(a, p, i);
+        maybe_map(a, i, q);
+        if (i >= nextupdate) {
+            nextupdate = report_update(a, i);
+        }
+        return p;
+    }
+}
+
+void run_serial(Int *a, size_t& back, size_t& nextupdate) {
+    for (size_t i = 3; i <= MAX; ++i) {
+        insert_one(a, i, a[i], back, nextupdate);
+    }
+}
+
+struct Barrier {
+    explicit Barrier(int n) : n_(n) {}
+    void arrive_and_wait() {
+        std::unique_lock<std::mutex> lk(m_);
+        size_t gen = generation_;
+        if (++waiting_ == n_) {
+            waiting_ = 0;
+            generation_ += 1;
+            cv_.notify_all();
+        } else {
+            cv_.wait(lk, [&]() { return gen != generation_; });
+        }
+    }
+private:
+    std::mutex m_;
+    std::condition_variable cv_;
+    int n_;
+    int waiting_ = 0;
+    size_t generation_ = 0;
+};
+
+// The windowed engine proceeds in windows [lo, hi) of WINDOW consecutive `i`.
+// First, all threads (the committer included) snapshot `spec[i-lo] = a[i]` for their
+// slice of the window, and touch the entries that inserting `i` will write.
+// Then the committer alone applies the insertions in order. A snapshot of a[j] can
+// have been invalidated only by an earlier insertion `k` in the same window that
+// mapped `k+p` or `k+q` onto `j`; those `j` are marked in `dirty` and re-read.
+
+void run_windowed(Int *a, size_t& back, size_t& nextupdate) {
+    std::vector<Int> spec(WINDOW);
+    std::vector<unsigned char> dirty(WINDOW);
+    std::vector<size_t> sink(THREADS * 8);
+    Barrier barrier(THREADS);
+    size_t lo = 3;
+    bool done = false;
+
+    auto snapshot = [&](int t) {
+        size_t hi = std::min<size_t>(lo + WINDOW, size_t(MAX) + 1);
+        size_t chunk = (hi - lo + THREADS - 1) / THREADS;
+        size_t first = lo + t * chunk;
+        size_t last = std::min(hi, first + chunk);
+        size_t touched = 0;
+        for (size_t i = first; i < last; ++i) {
+            size_t p = a[i];
+            spec[i - lo] = p;
+            if (p != 0) {
+                touched += a[p];
+                if (i + p < MAX) touched += a[i + p];
+                if (2*i - p < MAX) touched += a[2*i - p];
+            }
+        }
+        sink[t * 8] += touched;
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < THREADS; ++t) {
+        workers.emplace_back([&, t]() {
+            while (true) {
+                barrier.arrive_and_wait();
+                if (done) return;
+                snapshot(t);
+                barrier.arrive_and_wait();
+            }
+        });
+    }
+
+    while (lo <= MAX) {
+        size_t hi = std::min<size_t>(lo + WINDOW, size_t(MAX) + 1);
+        barrier.arrive_and_wait();
+        snapshot(0);
+        barrier.arrive_and_wait();
+        std::fill(dirty.begin(), dirty.end(), 0);
+        for (size_t i = lo; i < hi; ++i) {
+            size_t p = dirty[i - lo] ? size_t(a[i]) : size_t(spec[i - lo]);
+            if (i + 8 < hi && !dirty[i + 8 - lo]) {
+                size_t pp = spec[i + 8 - lo];
+                if (pp != 0) {
+                    __builtin_prefetch(&a[pp], 1);
+                    __builtin_prefetch(&a[i + 8 + pp], 1);
+                }
+            }
+            bool appended = (p == 0);
+            p = insert_one(a, i, p, back, nextupdate);
+            if (i + p < hi) dirty[i + p - lo] = 1;
+            if (!appended && 2*i - p < hi) dirty[2*i - p - lo] = 1;
+        }
+        lo = hi;
+    }
+    done = true;
+    barrier.arrive_and_wait();
+    for (auto& t : workers) t.join();
+}
+
 int main()
 {
     Int *a = (Int *)std::calloc(MAX+1, sizeof(Int));
@@ -135,28 +413,17 @@ int main()
     a[3] = 1;  // insert 3 after 1
     size_t back = 2;  // the last element of {0,1,2} is 2
     size_t nextupdate = 100'000;
-    for (size_t i = 3; i <= MAX; ++i) {
-        size_t p = a[i];
-        if (p == 0) {
-            p = back;
-            // Insert `i` after `p` in the list.
-            assert(a[p] == 0);
-            a[p] = i;
-            assert(a[i] == 0);
-            back = i;
-            maybe_map(a, p, i);
-        } else {
-            Int q = i - p;
-            assert(q == a[p]);
-            // Now insert `i` between `p` and `q` in the list.
-            a[i] = a[p];
-            a[p] = i;
-            maybe_map(a, p, i);
-            maybe_map(a, i, q);
-            if (i >= nextupdate) {
-                nextupdate = print_update(a, i);
-            }
-        }
+#ifdef STREAM
+    g_stable.open("b360447.txt");
+#endif
+    if (THREADS > 1) {
+        run_windowed(a, back, nextupdate);
+    } else {
+        run_serial(a, back, nextupdate);
     }
+#ifdef STREAM
+    stream_final_update(a, MAX);
+#else
     print_final_update(a, MAX);
+#endif
 }
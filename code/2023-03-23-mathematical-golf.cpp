@@ -1,9 +1,22 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <climits>
 #include <cstdio>
 #include <string>
+#include <thread>
 #include <vector>
 
+// Compile with "g++ -O3 -march=native -pthread mathematical-golf.cpp".
+// (-O3, so that score_lanes() below gets vectorized.)
+// Add -DTHREADS=8 to search for the hardest course on 8 threads at once.
+// The output is the same either way.
+
+#ifndef THREADS
+ #define THREADS 1
+#endif
+
 bool overshoot = true;
 
 struct MinScore {
@@ -80,35 +93,349 @@ int score_for(bool allow_overshoot, int hole, int driver, int putter) {
     }
 }
 
+// score_for() spends most of its time in its three inner loops, testing one
+// stroke count at a time. But each loop is looking for the smallest (or largest)
+// stroke count d satisfying a linear congruence like d*driver == hole (mod putter),
+// and the cost is monotonic in d, so we can jump straight to the answer
+// using the inverse of driver/g modulo putter/g from the extended Euclidean
+// algorithm. The kernel below scores one hole for every putter of a fixed
+// driver at once; it's branch-free and laid out struct-of-arrays, so that
+// the compiler can run the putters in SIMD lanes. There's no SIMD integer
+// division, so every division goes through a floating-point reciprocal
+// followed by an exact integer correction.
+
+inline int quot(int x, int n, double rn) {
+    // x / n, for x >= 0, given rn == 1.0 / n
+    int q = int(x * rn);
+    int r = x - q*n;
+    return q + (r >= n) - (r < 0);
+}
+
+inline int mulmod(int a, int b, int m, double rm) {
+    // (a * b) % m, for 0 <= a,b < m, given rm == 1.0 / m. The product can
+    // overflow an int, but it's exact in a double as long as m < 2^26.
+    double x = double(a) * b;
+    int q = int(x * rm);
+    int r = int(x - double(q) * m);
+    return r + m*(r < 0) - m*(r >= m);
+}
+
+struct PutterLanes {
+    // For a fixed driver, one lane per putter in 1..driver-1.
+    int driver;
+    double rdriver;
+    std::vector<int> g;     // gcd(driver, putter)
+    std::vector<int> mp;    // putter / g
+    std::vector<int> md;    // driver / g
+    std::vector<int> dinv;  // inverse of driver/g modulo putter/g
+    std::vector<int> pinv;  // inverse of putter/g modulo driver/g
+    std::vector<double> rputter, rg, rmp, rmd;  // reciprocals of the above
+
+    explicit PutterLanes(int driver) : driver(driver), rdriver(1.0 / driver) {
+        assert(driver < (1 << 26));  // for mulmod()
+        for (int putter = 1; putter < driver; ++putter) {
+            // Invariant: x0*driver + y0*putter == r0
+            int r0 = driver, r1 = putter, x0 = 1, x1 = 0, y0 = 0, y1 = 1;
+            while (r1 != 0) {
+                int q = r0 / r1;
+                r0 -= q*r1; std::swap(r0, r1);
+                x0 -= q*x1; std::swap(x0, x1);
+                y0 -= q*y1; std::swap(y0, y1);
+            }
+            g.push_back(r0);
+            mp.push_back(putter / r0);
+            md.push_back(driver / r0);
+            dinv.push_back((x0 % mp.back() + mp.back()) % mp.back());
+            pinv.push_back((y0 % md.back() + md.back()) % md.back());
+            rputter.push_back(1.0 / putter);
+            rg.push_back(1.0 / r0);
+            rmp.push_back(1.0 / mp.back());
+            rmd.push_back(1.0 / md.back());
+        }
+    }
+};
+
+// Write each putter's score for this hole into score[i], for putter i+1.
+// Lane by lane, this is identical to score_for(), including its INT_MAX
+// for a hole that can't be finished.
+template<bool AllowOvershoot>
+void score_lanes(int hole, const PutterLanes& lanes, int *score) {
+    const int D = lanes.driver;
+    const int n = D - 1;
+    if (hole % D == 0) {
+        std::fill(score, score + n, hole / D);  // Drive forward
+        return;
+    }
+    int c0 = 100;
+    if (AllowOvershoot && (hole+1) % D == 0) {
+        c0 = std::min(c0, (hole+1) / D);  // Drive forward, overshooting
+    }
+    if (AllowOvershoot && (hole-1) % D == 0) {
+        c0 = std::min(c0, ((hole-1) / D) + 2);  // Drive forward, then drive backward
+    }
+    const int U = hole / D;
+    const double rD = lanes.rdriver;
+    const int *gv = lanes.g.data(), *mpv = lanes.mp.data(), *mdv = lanes.md.data();
+    const int *dinvv = lanes.dinv.data(), *pinvv = lanes.pinv.data();
+    const double *rPv = lanes.rputter.data(), *rgv = lanes.rg.data();
+    const double *rmpv = lanes.rmp.data(), *rmdv = lanes.rmd.data();
+    for (int i = 0; i < n; ++i) {
+        const int P = i + 1, g = gv[i], mp = mpv[i], md = mdv[i];
+        const double rP = rPv[i], rg = rgv[i], rmp = rmpv[i], rmd = rmdv[i];
+
+        // The least x >= 0 with x*(a/g) == r/g (mod m), given rq == r/g.
+        auto least_solution = [](int rq, int m, double rm, int inv) {
+            return mulmod(rq - quot(rq, m, rm) * m, inv, m, rm);
+        };
+        // The least x >= lo with x == x0 (mod m).
+        auto least_at_or_above = [](int x0, int lo, int m, double rm) {
+            return x0 + quot(std::max(lo - x0, 0) + m - 1, m, rm) * m;
+        };
+        // Drive forward d times, then putt forward onto (or past) the hole.
+        // The cost falls as d rises, so we want the largest d <= U.
+        // If there's no such d, the cost is discarded; but d itself can be
+        // nearly `putter`, so don't let d*D overflow on the way.
+        auto drive_then_putt_forward = [&](int r) {
+            int rq = quot(r, g, rg);
+            int d = least_solution(rq, mp, rmp, dinvv[i]);
+            int dmax = d + quot(std::max(U - d, 0), mp, rmp) * mp;
+            int cost = dmax + quot(r - std::min(dmax, U)*D, P, rP);
+            return cost + 100*(rq*g != r || d > U);
+        };
+        // Drive forward d times, past the hole, then putt backward.
+        // The cost rises with d, so we want the smallest d > U.
+        auto drive_then_putt_backward = [&](int r) {
+            int rq = quot(r, g, rg);
+            int d = std::min(least_at_or_above(least_solution(rq, mp, rmp, dinvv[i]), U+1, mp, rmp), 100);
+            int cost = d + quot(std::max(d*D - r, 0), P, rP);
+            return cost + 100*(rq*g != r);
+        };
+        // Putt forward p times, past the hole, then drive backward.
+        auto putt_then_drive_backward = [&](int r) {
+            int rq = quot(r, g, rg);
+            int p = std::min(least_at_or_above(least_solution(rq, md, rmd, pinvv[i]), quot(hole, P, rP) + 1, md, rmd), 100);
+            int cost = p + quot(std::max(p*P - r, 0), D, rD);
+            return cost + 100*(rq*g != r);
+        };
+
+        int c = c0;
+        c = std::min(c, drive_then_putt_forward(hole));
+        c = std::min(c, drive_then_putt_backward(hole));
+        c = std::min(c, putt_then_drive_backward(hole));
+        if (AllowOvershoot) {
+            int q = quot(hole-1, P, rP);
+            c = std::min(c, q + 2 + 100*(q*P != hole-1));  // Putt forward, then putt backward
+            c = std::min(c, drive_then_putt_forward(hole+1));
+            c = std::min(c, drive_then_putt_backward(hole-1));
+            c = std::min(c, putt_then_drive_backward(hole-1));
+        }
+        score[i] = (c < 100) ? c : INT_MAX;
+    }
+}
+
+void score_lanes(bool allow_overshoot, int hole, const PutterLanes& lanes, int *score) {
+    assert(hole >= 0);
+    if (allow_overshoot) {
+        score_lanes<true>(hole, lanes, score);
+    } else {
+        score_lanes<false>(hole, lanes, score);
+    }
+}
+
 MinScore solve(bool allow_overshoot, const std::vector<int>& holes) {
     int max = *std::max_element(holes.begin(), holes.end());
     MinScore minscore = { INT_MAX, 0, 0 };
+    std::vector<int> score(28*max);
+    std::vector<int> total(28*max);
+    std::vector<int> bad(28*max);
     for (int driver = 2; driver < 28*max; ++driver) {
-        for (int putter = 1; putter < driver; ++putter) {
-            int score = 0;
-            for (int hole : holes) {
-                int s = score_for(allow_overshoot, hole, driver, putter);
-                if (s == INT_MAX) {
-                    score = INT_MAX;
-                    break;
+        PutterLanes lanes(driver);
+        std::fill(total.begin(), total.end(), 0);
+        std::fill(bad.begin(), bad.end(), 0);
+        for (int hole : holes) {
+            score_lanes(allow_overshoot, hole, lanes, score.data());
+            for (int i = 0; i < driver - 1; ++i) {
+                bad[i] |= (score[i] == INT_MAX);
+                total[i] += (score[i] == INT_MAX) ? 0 : score[i];
+            }
+        }
+        for (int i = 0; i < driver - 1; ++i) {
+            if (!bad[i] && total[i] < minscore.score) {
+                minscore = { total[i], driver, i + 1 };
+            }
+        }
+    }
+    return minscore;
+}
+
+// Check score_lanes() against score_for() for every pair of clubs that
+// solve() would try on this course, and report the first disagreement.
+bool check_score_lanes(bool allow_overshoot, const std::vector<int>& holes) {
+    int max = *std::max_element(holes.begin(), holes.end());
+    std::vector<int> score(28*max);
+    for (int driver = 2; driver < 28*max; ++driver) {
+        PutterLanes lanes(driver);
+        for (int hole : holes) {
+            score_lanes(allow_overshoot, hole, lanes, score.data());
+            for (int putter = 1; putter < driver; ++putter) {
+                int expected = score_for(allow_overshoot, hole, driver, putter);
+                if (score[putter - 1] != expected) {
+                    printf("Hole %d with driver %d and putter %d: score_lanes says %d, score_for says %d\n",
+                        hole, driver, putter, score[putter - 1], expected);
+                    return false;
                 }
-                score += s;
             }
-            if (score < minscore.score) {
-                minscore = { score, driver, putter };
+        }
+    }
+    return true;
+}
+
+// The hardest-course search solves thousands of courses drawn from the same
+// handful of hole lengths, so there it's cheaper to score every (hole, driver,
+// putter) once up front; solving a course is then just adding up rows.
+class ScoreTable {
+public:
+    explicit ScoreTable(bool allow_overshoot, int max_hole) :
+        max_hole_(max_hole), offset_(28*max_hole + 1)
+    {
+        assert(2 <= max_hole && bytes_needed(max_hole) <= MAX_BYTES);
+        size_t n = 0;
+        for (int driver = 2; driver <= 28*max_hole; ++driver) {
+            offset_[driver] = n;
+            n += size_t(max_hole) * (driver - 1);
+        }
+        scores_.resize(n);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&, t]() {
+                std::vector<int> score(28*max_hole);
+                for (int driver = 2 + t; driver < 28*max_hole; driver += THREADS) {
+                    PutterLanes lanes(driver);
+                    for (int hole = 0; hole < max_hole; ++hole) {
+                        score_lanes(allow_overshoot, hole, lanes, score.data());
+                        unsigned char *r = &scores_[offset_[driver] + size_t(hole) * (driver - 1)];
+                        for (int i = 0; i < driver - 1; ++i) {
+                            r[i] = (score[i] == INT_MAX) ? NO_SCORE : score[i];
+                        }
+                    }
+                }
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+    }
+
+    int max_hole() const { return max_hole_; }
+
+    // The scores of this hole for putters 1..driver-1, or NO_SCORE.
+    const unsigned char *row(int hole, int driver) const {
+        assert(0 <= hole && hole < max_hole_ && 2 <= driver && driver < 28*max_hole_);
+        return &scores_[offset_[driver] + size_t(hole) * (driver - 1)];
+    }
+
+    // Scores are always under 100, so they fit in a byte; the table
+    // itself, though, grows like 392*max_hole^3 bytes.
+    static constexpr unsigned char NO_SCORE = 255;
+    static constexpr size_t MAX_BYTES = size_t(4) << 30;
+
+    static size_t bytes_needed(int max_hole) {
+        size_t drivers = 28*size_t(max_hole) - 1;  // 2 through 28*max_hole
+        return size_t(max_hole) * drivers * (drivers + 1) / 2;
+    }
+
+private:
+    int max_hole_;
+    std::vector<size_t> offset_;
+    std::vector<unsigned char> scores_;
+};
+
+// Branch and bound: as soon as some pair of clubs scores `cutoff` or less,
+// stop and return it, because this course can't be harder than `cutoff`.
+// Otherwise the result is exact.
+MinScore solve(const ScoreTable& table, const std::vector<int>& holes, int cutoff = INT_MIN) {
+    int max = *std::max_element(holes.begin(), holes.end());
+    MinScore minscore = { INT_MAX, 0, 0 };
+    std::vector<int> total(28*max);
+    std::vector<int> worst(28*max);
+    for (int driver = 2; driver < 28*max; ++driver) {
+        std::fill(total.begin(), total.end(), 0);
+        std::fill(worst.begin(), worst.end(), 0);
+        for (int hole : holes) {
+            const unsigned char *score = table.row(hole, driver);
+            for (int i = 0; i < driver - 1; ++i) {
+                total[i] += score[i];
+                worst[i] = std::max<int>(worst[i], score[i]);
+            }
+        }
+        for (int i = 0; i < driver - 1; ++i) {
+            if (worst[i] != ScoreTable::NO_SCORE && total[i] < minscore.score) {
+                minscore = { total[i], driver, i + 1 };
             }
         }
+        if (minscore.score <= cutoff) {
+            return minscore;
+        }
     }
     return minscore;
 }
 
+// Find the hardest 4-hole course with every hole less than table.max_hole(),
+// printing each new record in the same order as a plain loop over the courses.
+// Courses are solved in rounds, THREADS at a time; every course in a round
+// gets the record as of the start of the round as its cutoff, and then the
+// main thread commits the round's results in order.
+void find_hardest_course(const ScoreTable& table) {
+    const int max_hole = table.max_hole();
+    std::vector<std::array<int, 4>> courses;
+    for (int a = 2; a < max_hole; ++a) {
+        for (int b = 2; b < a; ++b) {
+            for (int c = 2; c < b; ++c) {
+                for (int d = 2; d < c; ++d) {
+                    courses.push_back({a,b,c,d});
+                }
+            }
+        }
+    }
+    const size_t round_size = 64 * THREADS;
+    std::vector<MinScore> results(round_size);
+    int ms = INT_MIN;
+    for (size_t lo = 0; lo < courses.size(); lo += round_size) {
+        size_t hi = std::min(courses.size(), lo + round_size);
+        std::atomic<size_t> next(lo);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&]() {
+                for (size_t i; (i = next++) < hi; ) {
+                    const std::array<int, 4>& course = courses[i];
+                    results[i - lo] = solve(table, {course.begin(), course.end()}, ms);
+                }
+            });
+        }
+        for (auto& th : threads) {
+            th.join();
+        }
+        for (size_t i = lo; i < hi; ++i) {
+            const std::array<int, 4>& course = courses[i];
+            const MinScore& minscore = results[i - lo];
+            if (minscore.score > ms) {
+                printf("%d %d %d %d -- Best: %d strokes with driver %d and putter %d\n",
+                    course[0], course[1], course[2], course[3], minscore.score, minscore.driver, minscore.putter);
+                ms = minscore.score;
+            }
+        }
+    }
+}
+
 int main(int argc, char **argv)
 {
     if (argc == 1) {
         puts("./golf basic 10 15 16 29  -- find the best pair of clubs");
         puts("./golf advanced 10 15 16 29 -- as above, but permit overshoot by 1");
         puts("./golf (basic|advanced) clubs 5 4 10 15 16 29 -- print a hole-by-hole breakdown of (10,15,16,29) using clubs (5,4)");
+        puts("./golf (basic|advanced) check 10 15 16 29 -- check the fast scorer against the slow one on every pair of clubs tried");
         puts("./golf (basic|advanced) -- find the hardest 4-hole course less than (20,20,20,20)");
+        puts("./golf (basic|advanced) hardest 40 -- find the hardest 4-hole course less than (40,40,40,40)");
         return 0;
     }
     bool allow_overshoot = false;
@@ -132,7 +459,17 @@ int main(int argc, char **argv)
             int s = score_for(allow_overshoot, hole, driver, putter);
             printf("- %d in %d strokes\n", hole, s);
         }
-    } else if (argc >= 2) {
+    } else if (argc >= 3 && (argv[1] == std::string("check"))) {
+        std::vector<int> holes;
+        for (int i = 2; i < argc; ++i) {
+            holes.push_back(atoi(argv[i]));
+        }
+        if (check_score_lanes(allow_overshoot, holes)) {
+            puts("OK");
+        } else {
+            return 1;
+        }
+    } else if (argc >= 2 && argv[1] != std::string("hardest")) {
         // Find the best possible score for this specific course of holes.
         std::vector<int> holes;
         for (int i = 1; i < argc; ++i) {
@@ -142,20 +479,16 @@ int main(int argc, char **argv)
         printf("Best: %d strokes with driver %d and putter %d\n", minscore.score, minscore.driver, minscore.putter);
     } else {
         // Find the hardest possible course.
-        int ms = INT_MIN;
-        for (int a = 2; a < 20; ++a) {
-            for (int b = 2; b < a; ++b) {
-                for (int c = 2; c < b; ++c) {
-                    for (int d = 2; d < c; ++d) {
-                        MinScore minscore = solve(allow_overshoot, {a,b,c,d});
-                        if (minscore.score > ms) {
-                            printf("%d %d %d %d -- Best: %d strokes with driver %d and putter %d\n",
-                                a,b,c,d, minscore.score, minscore.driver, minscore.putter);
-                            ms = minscore.score;
-                        }
-                    }
-                }
-            }
+        int max_hole = (argc >= 3) ? atoi(argv[2]) : 20;
+        if (max_hole < 2) {
+            printf("The hole bound must be at least 2\n");
+            return 1;
+        } else if (ScoreTable::bytes_needed(max_hole) > ScoreTable::MAX_BYTES) {
+            printf("The hole bound %d would need a %zu MB score table; the limit is %zu MB\n",
+                max_hole, ScoreTable::bytes_needed(max_hole) >> 20, ScoreTable::MAX_BYTES >> 20);
+            return 1;
         }
+        ScoreTable table(allow_overshoot, max_hole);
+        find_hardest_course(table);
     }
 }
@@ -1,36 +1,60 @@
-// Compile with e.g. `g++ -std=c++17 -DN=10 -DK=5 solver.cpp`
+// Compile with e.g. `g++ -std=c++17 -O2 -pthread -DTHREADS=8 solver.cpp`
+// Run with e.g. `./a.out 10 5` to solve N=10, K=5; or `./a.out --grid 6 10` to
+// solve every K for each N from 6 to 10, and print the results as tables.
+// The search code is instantiated for every N up to MAX_N.
+// By default we use a bidirectional search over hashed positions.
+// Add -DONE_SIDED_BFS to search only forward from the initial list, or
+// -DSET_BFS to use the original std::set-based search.
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <ctime>
 #include <iterator>
+#include <map>
 #include <numeric>
 #include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include "combinations.h" // https://github.com/HowardHinnant/combinations
 
+#ifndef THREADS
+ #define THREADS 1
+#endif
+
+static constexpr int MIN_N = 2;
+#ifndef MAX_N
+ #define MAX_N 20
+#endif
+
 using Int = signed char;
 
+template<int N>
 struct Position {
   Int data_[N];
   int size_;
   struct Less {
-    bool operator()(const Position& lhs, const Position& rhs) const {
+    bool operator()(const Position<N>& lhs, const Position<N>& rhs) const {
       if (lhs.size_ != rhs.size_) return lhs.size_ < rhs.size_;
       return std::lexicographical_compare(lhs.data_, lhs.data_ + lhs.size_, rhs.data_, rhs.data_ + rhs.size_);
     }
   };
-  friend bool operator==(const Position& lhs, const Position& rhs) {
+  friend bool operator==(const Position<N>& lhs, const Position<N>& rhs) {
     return std::equal(lhs.data_, lhs.data_ + lhs.size_, rhs.data_, rhs.data_ + rhs.size_);
   }
-  friend bool operator!=(const Position& lhs, const Position& rhs) {
+  friend bool operator!=(const Position<N>& lhs, const Position<N>& rhs) {
     return !std::equal(lhs.data_, lhs.data_ + lhs.size_, rhs.data_, rhs.data_ + rhs.size_);
   }
   bool contains(Int k) const {
     return std::find(data_, data_ + size_, k) != data_ + size_;
   }
-  Position reversed() const {
+  Position<N> reversed() const {
     auto copy = *this;
     std::reverse(copy.data_, copy.data_ + copy.size_);
     return copy;
@@ -42,12 +66,12 @@ struct Position {
   }
 };
 
-template<class Function>
-bool for_each_neighbor_position(int constrain_length, const Position& p, const Function& f) {
+template<int N, class Function>
+bool for_each_neighbor_position(int constrain_length, const Position<N>& p, const Function& f) {
   if (p.size_ < constrain_length) {
     // Try splitting
     for (int i = 0; i < p.size_; ++i) {
-      Position n;
+      Position<N> n;
       n.size_ = p.size_ + 1;
       std::copy(p.data_, p.data_ + i, n.data_);
       std::copy(p.data_ + i + 1, p.data_ + p.size_, n.data_ + i + 2);
@@ -74,7 +98,7 @@ bool for_each_neighbor_position(int constrain_length, const Position& p, const F
     if (sum > N || p.contains(sum)) {
       continue;
     }
-    Position n;
+    Position<N> n;
     n.size_ = p.size_ - 1;
     std::copy(p.data_, p.data_ + i - 1, n.data_);
     n.data_[i-1] = sum;
@@ -85,18 +109,19 @@ bool for_each_neighbor_position(int constrain_length, const Position& p, const F
   return false;
 }
 
-int moves_to_reverse(const Position& originalp, int constrain_length) {
+template<int N>
+int moves_to_reverse_set(const Position<N>& originalp, int constrain_length) {
   if (originalp.size_ == 1) return 0;
-  Position reversed_originalp = originalp.reversed();
-  std::set<Position, Position::Less> wrong_interior;
-  std::set<Position, Position::Less> right_interior;
-  std::set<Position, Position::Less> frontier = { {originalp} };
+  Position<N> reversed_originalp = originalp.reversed();
+  std::set<Position<N>, typename Position<N>::Less> wrong_interior;
+  std::set<Position<N>, typename Position<N>::Less> right_interior;
+  std::set<Position<N>, typename Position<N>::Less> frontier = { {originalp} };
   int moves = 1;
   while (true) {
     if (true) {
       auto oldfrontier = std::move(frontier);
-      for (const Position& p : oldfrontier) {
-        (void)for_each_neighbor_position(constrain_length, p, [&](const Position& n) {
+      for (const Position<N>& p : oldfrontier) {
+        (void)for_each_neighbor_position(constrain_length, p, [&](const Position<N>& n) {
           // n has "wrong" parity.
           if (wrong_interior.find(n) == wrong_interior.end()) {
             frontier.insert(n);
@@ -110,8 +135,8 @@ int moves_to_reverse(const Position& originalp, int constrain_length) {
     moves += 1;
     if (true) {
       auto oldfrontier = std::move(frontier);
-      for (const Position& p : oldfrontier) {
-        bool success = for_each_neighbor_position(constrain_length, p, [&](const Position& n) {
+      for (const Position<N>& p : oldfrontier) {
+        bool success = for_each_neighbor_position(constrain_length, p, [&](const Position<N>& n) {
           // n has "right" parity.
           if (right_interior.find(n) == right_interior.end()) {
             if (n == reversed_originalp) return true;
@@ -128,8 +153,260 @@ int moves_to_reverse(const Position& originalp, int constrain_length) {
   }
 }
 
-template<class Function>
-void for_each_list(int k, const Function& f) {
+// The hashed engine packs each Position into an integer Key, five bits per element
+// (every element is between 1 and N <= 25), so that a zero field marks the end of the list.
+// Visited positions live in open-addressing hash tables, one for each parity of length
+// (every move changes the length by 1), and each BFS level is a flat vector of Keys.
+
+template<int N>
+using Key = std::conditional_t<(5 * N <= 64), uint64_t, unsigned __int128>;
+
+template<int N>
+Key<N> encode(const Position<N>& p) {
+  static_assert(N < 32, "Each element must fit in five bits");
+  static_assert(5 * N <= 128, "Each Position must fit in a Key");
+  Key<N> k = 0;
+  for (int i = p.size_ - 1; i >= 0; --i) {
+    k = (k << 5) | Key<N>(p.data_[i]);
+  }
+  return k;
+}
+
+template<int N>
+Position<N> decode(Key<N> k) {
+  Position<N> p;
+  p.size_ = 0;
+  while (k != 0) {
+    p.data_[p.size_++] = Int(k & 31);
+    k >>= 5;
+  }
+  return p;
+}
+
+// An open-addressing hash table from Keys to non-negative values
+// (the bidirectional search stores each position's distance from its origin).
+template<class KeyT>
+class KeyTable {
+  std::vector<KeyT> keys_;  // 0 means the slot is empty
+  std::vector<int> values_;
+  size_t size_ = 0;
+
+  static size_t hash(KeyT k) {
+    uint64_t h = uint64_t(k);
+    if constexpr (sizeof(KeyT) > 8) {
+      h ^= uint64_t(k >> 64) * 0x9e3779b97f4a7c15ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  void grow() {
+    std::vector<KeyT> oldkeys = std::move(keys_);
+    std::vector<int> oldvalues = std::move(values_);
+    keys_.assign(oldkeys.empty() ? 1024 : 2 * oldkeys.size(), KeyT(0));
+    values_.assign(keys_.size(), 0);
+    size_t mask = keys_.size() - 1;
+    for (size_t j = 0; j < oldkeys.size(); ++j) {
+      if (oldkeys[j] != 0) {
+        size_t i = hash(oldkeys[j]) & mask;
+        while (keys_[i] != 0) i = (i + 1) & mask;
+        keys_[i] = oldkeys[j];
+        values_[i] = oldvalues[j];
+      }
+    }
+  }
+
+public:
+  // Returns true if `k` was newly inserted.
+  bool insert(KeyT k, int value = 0) {
+    if (2 * (size_ + 1) > keys_.size()) {
+      grow();
+    }
+    size_t mask = keys_.size() - 1;
+    for (size_t i = hash(k) & mask; true; i = (i + 1) & mask) {
+      if (keys_[i] == k) return false;
+      if (keys_[i] == 0) {
+        keys_[i] = k;
+        values_[i] = value;
+        size_ += 1;
+        return true;
+      }
+    }
+  }
+
+  template<class F>
+  void for_each(const F& f) const {
+    for (size_t i = 0; i < keys_.size(); ++i) {
+      if (keys_[i] != 0) f(keys_[i], values_[i]);
+    }
+  }
+
+  // Returns the value associated with `k`, or -1 if `k` isn't present.
+  int find(KeyT k) const {
+    if (keys_.empty()) return -1;
+    size_t mask = keys_.size() - 1;
+    for (size_t i = hash(k) & mask; true; i = (i + 1) & mask) {
+      if (keys_[i] == k) return values_[i];
+      if (keys_[i] == 0) return -1;
+    }
+  }
+};
+
+template<int N>
+int moves_to_reverse_hashed(const Position<N>& originalp, int constrain_length) {
+  if (originalp.size_ == 1) return 0;
+  Key<N> target = encode(originalp.reversed());
+  KeyTable<Key<N>> seen[2];  // indexed by the parity of the length
+  std::vector<Key<N>> frontier = { encode(originalp) };
+  std::vector<Key<N>> next;
+  seen[originalp.size_ % 2].insert(frontier[0]);
+  for (int moves = 1; true; ++moves) {
+    next.clear();
+    KeyTable<Key<N>>& seen_next = seen[(originalp.size_ + moves) % 2];
+    bool success = false;
+    for (Key<N> pk : frontier) {
+      success = for_each_neighbor_position(constrain_length, decode<N>(pk), [&](const Position<N>& n) {
+        Key<N> nk = encode(n);
+        if (nk == target) return true;
+        if (seen_next.insert(nk)) {
+          next.push_back(nk);
+        }
+        return false;
+      });
+      if (success) return moves;
+    }
+    if (next.empty()) return -1;
+    frontier.swap(next);
+  }
+}
+
+// Every move is reversible: a split is undone by a merge, and vice versa. Since no
+// reachable position is longer than `constrain_length`, the reverse of every allowed
+// move is also allowed. So we can search outward from both ends at once, always
+// expanding whichever side has the smaller frontier, until the two searches meet.
+// Each side remembers every position's distance from its own origin; as soon as
+// a newly discovered position is found on the other side, we know the total.
+// If instead one side runs out of positions, it has explored the whole connected
+// component of its origin; we pass its positions of the original parity to `on_unreachable`.
+
+template<int N, class F>
+int moves_to_reverse_bidirectional(const Position<N>& originalp, int constrain_length, const F& on_unreachable) {
+  if (originalp.size_ == 1) return 0;
+  struct Side {
+    KeyTable<Key<N>> seen[2];  // indexed by the parity of the length
+    std::vector<Key<N>> frontier;
+    int depth = 0;
+  };
+  Side sides[2];
+  Key<N> origins[2] = { encode(originalp), encode(originalp.reversed()) };
+  for (int s = 0; s < 2; ++s) {
+    sides[s].frontier.push_back(origins[s]);
+    sides[s].seen[originalp.size_ % 2].insert(origins[s], 0);
+  }
+  std::vector<Key<N>> next;
+  while (true) {
+    int s = (sides[0].frontier.size() <= sides[1].frontier.size()) ? 0 : 1;
+    Side& me = sides[s];
+    Side& other = sides[1 - s];
+    me.depth += 1;
+    int parity = (originalp.size_ + me.depth) % 2;
+    next.clear();
+    int total = -1;
+    for (Key<N> pk : me.frontier) {
+      bool success = for_each_neighbor_position(constrain_length, decode<N>(pk), [&](const Position<N>& n) {
+        Key<N> nk = encode(n);
+        if (me.seen[parity].insert(nk, me.depth)) {
+          int d = other.seen[parity].find(nk);
+          if (d != -1) {
+            total = me.depth + d;
+            return true;
+          }
+          next.push_back(nk);
+        }
+        return false;
+      });
+      if (success) return total;
+    }
+    if (next.empty()) {
+      on_unreachable(me.seen[originalp.size_ % 2]);
+      return -1;
+    }
+    me.frontier.swap(next);
+  }
+}
+
+template<int N>
+int moves_to_reverse_bidirectional(const Position<N>& originalp, int constrain_length) {
+  return moves_to_reverse_bidirectional(originalp, constrain_length, [](const KeyTable<Key<N>>&) {});
+}
+
+template<int N>
+int moves_to_reverse(const Position<N>& originalp, int constrain_length) {
+#if defined(SET_BFS)
+  return moves_to_reverse_set(originalp, constrain_length);
+#elif defined(ONE_SIDED_BFS)
+  return moves_to_reverse_hashed(originalp, constrain_length);
+#else
+  return moves_to_reverse_bidirectional(originalp, constrain_length);
+#endif
+}
+
+// `main` asks about the same lists many times over, at various lengths L; and many
+// lists share a connected component of the move graph. So for each L we remember
+// the answer for every list we've solved (keyed by the lesser of its Key and its
+// reverse's Key, since those two lists have the same answer), and the component id
+// of every same-length position in each component that a search has fully explored.
+// A list whose component is known, but doesn't contain its reverse, is unsolvable.
+
+template<int N>
+class ReversalCache {
+  struct PerLength {
+    KeyTable<Key<N>> answers;    // canonical Key -> moves + 1
+    KeyTable<Key<N>> component;  // Key -> component id
+  };
+  std::vector<PerLength> per_length_ = std::vector<PerLength>(N + 1);
+  int next_component_ = 0;
+
+public:
+  int moves_to_reverse(const Position<N>& p, int constrain_length) {
+    PerLength& cache = per_length_[constrain_length];
+    Key<N> k = encode(p);
+    Key<N> rk = encode(p.reversed());
+    Key<N> canonical = std::min(k, rk);
+    int answer = cache.answers.find(canonical);
+    if (answer != -1) {
+      return answer - 1;
+    }
+    int c = cache.component.find(k);
+    int moves;
+    if (c != -1 && cache.component.find(rk) != c) {
+      moves = -1;
+    } else {
+#if defined(SET_BFS) || defined(ONE_SIDED_BFS)
+      moves = ::moves_to_reverse<N>(p, constrain_length);
+#else
+      moves = moves_to_reverse_bidirectional(p, constrain_length, [&](const KeyTable<Key<N>>& seen) {
+        int id = next_component_++;
+        seen.for_each([&](Key<N> sk, int) {
+          if (decode<N>(sk).size_ == p.size_) {
+            cache.component.insert(sk, id);
+          }
+        });
+      });
+#endif
+    }
+    cache.answers.insert(canonical, moves + 1);
+    return moves;
+  }
+};
+
+// Call f(p) for each list p with `k` elements whose first element is `lead`.
+// Calling this for every `lead` from 1 to N-1 visits each list of interest exactly once,
+// so the leading element is a convenient way to split the work between threads.
+template<int N, class Function>
+void for_each_list_with_lead(int k, int lead, const Function& f) {
   int nums[N];
   std::iota(nums, nums + N, 1);
   if (N >= 3) {
@@ -140,9 +417,12 @@ void for_each_list(int k, const Function& f) {
       // We won't be able to split N, so the missing number must be N-1
       // so that we can split N-2. Also, the sum to the left of N must
       // equal the sum to the right of N.
+      if (lead > N-2) return;
+      std::swap(nums[0], nums[lead-1]);
       int totalsum = N*(N+1)/2 - (N-1);
       int halfsum = (totalsum - N) / 2;
-      for_each_permutation(nums, nums + N - 2, nums + N - 2, [&](auto first, auto last) {
+      for_each_permutation(nums + 1, nums + N - 2, nums + N - 2, [&](auto, auto last) {
+        int *first = nums;
         // We only need to check half of all the positions, since the other half are just the first half reversed.
         if (*first > last[-1]) return false;
         // Find the one place it's legal to insert N into this list.
@@ -150,7 +430,7 @@ void for_each_list(int k, const Function& f) {
         for (int i=0; first+i != last; ++i) {
           leftsum += first[i];
           if (leftsum == halfsum) {
-            Position p;
+            Position<N> p;
             std::copy(first, first+i+1, p.data_);
             p.data_[i+1] = N;
             std::copy(first+i+1, last, p.data_+i+2);
@@ -165,16 +445,32 @@ void for_each_list(int k, const Function& f) {
     }
   }
   int size = k;
-  for_each_permutation(nums, nums + size - 1, nums + N - 1, [&](auto first, auto last) {
+  if (size == 1) {
+    // The only list is {N} itself.
+    if (lead == 1) {
+      Position<N> p;
+      p.data_[0] = N;
+      p.size_ = 1;
+      f(p);
+    }
+    return;
+  }
+  if (lead > N-1) return;
+  std::swap(nums[0], nums[lead-1]);
+  for_each_permutation(nums + 1, nums + size - 1, nums + N - 1, [&](auto, auto last) {
+    int *first = nums;
     // We only need to check half of all the positions, since the other half are just the first half reversed.
     if (*first > last[-1]) return false;
     // In any solvable list, the sum of the missing elements must exceed n-1.
     if (N*(N+1)/2 - std::accumulate(first, last, N) < N-1) return false;
-    Position p;
+    Position<N> p;
     std::copy(first, last, p.data_);
     p.size_ = size;
     p.data_[size - 1] = N;
     f(p);
+    // With only one other element, {lead, N} and {N, lead} are each other's
+    // reverses, so the half check above didn't rule either of them out.
+    if (size == 2) return false;
     for (int i = size - 1; i > 0; --i) {
       std::swap(p.data_[i], p.data_[i - 1]);
       f(p);
@@ -183,43 +479,189 @@ void for_each_list(int k, const Function& f) {
   });
 }
 
-int main() {
-  int C = 0;
-  int M = 0;
+template<int N, class Function>
+void for_each_list(int k, const Function& f) {
+  for (int lead = 1; lead < N; ++lead) {
+    for_each_list_with_lead<N>(k, lead, f);
+  }
+}
+
+// Run f(thread, task) for each task in [0, ntasks), handing out tasks in order
+// to whichever of the `nthreads` threads is free.
+template<class Function>
+void run_in_parallel(int nthreads, int ntasks, const Function& f) {
+  std::atomic<int> next_task{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int task = next_task++; task < ntasks; task = next_task++) {
+        f(t, task);
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+}
+
+struct Result {
+  int C = 0;  // the number of solvable lists
+  int M = 0;  // the most moves needed to reverse any solvable list
+  int L = 0;  // the shortest length limit within which every solvable list needs at most M moves
+};
+
+template<int N>
+Result solve(int K) {
   int start = time(NULL);
-  std::vector<Position> solvable;
-  for_each_list(K, [&](Position p) {
-    int moves = moves_to_reverse(p, N-1);
-    if (moves == -1) return;
-    // The list is solvable.
-    solvable.push_back(p);
-    C += 2;
-    if (moves > M) {
-      M = moves;
-    }
+  int nthreads = THREADS;
+  std::vector<ReversalCache<N>> caches(nthreads);
+  struct Tally {
+    int C = 0;
+    int M = 0;
+    std::vector<Position<N>> solvable;
+  };
+  std::vector<Tally> tallies(nthreads);
+  run_in_parallel(nthreads, N-1, [&](int t, int task) {
+    Tally& tally = tallies[t];
+    for_each_list_with_lead<N>(K, task + 1, [&](Position<N> p) {
+      int moves = caches[t].moves_to_reverse(p, N-1);
+      if (moves == -1) return;
+      // The list is solvable, and so is its reverse, which for_each_list skips;
+      // unless the list is its own reverse, which only {N} is.
+      tally.solvable.push_back(p);
+      bool palindrome = std::equal(p.data_, p.data_ + p.size_, std::make_reverse_iterator(p.data_ + p.size_));
+      tally.C += palindrome ? 1 : 2;
+      if (moves > tally.M) {
+        tally.M = moves;
+      }
+    });
   });
+  int C = 0;
+  int M = 0;
+  std::vector<Position<N>> solvable;
+  for (const Tally& tally : tallies) {
+    C += tally.C;
+    M = std::max(M, tally.M);
+    solvable.insert(solvable.end(), tally.solvable.begin(), tally.solvable.end());
+  }
   // Now C, M, and solvable are accurate.
-  int L = K;
-  for (const Position& p : solvable) {
+  // L only ever increases, so each thread can start from the largest L found so far.
+  std::atomic<int> sharedL{K};
+  run_in_parallel(nthreads, solvable.size(), [&](int t, int i) {
+    const Position<N>& p = solvable[i];
     // Can we solve this list with a smaller L?
+    int L = sharedL;
     while (true) {
-      int m2 = moves_to_reverse(p, L);
+      int m2 = caches[t].moves_to_reverse(p, L);
       if (m2 == -1 || m2 > M) {
         ++L;
       } else {
         break;
       }
     }
-  }
+    int oldL = sharedL;
+    while (oldL < L && !sharedL.compare_exchange_weak(oldL, L)) {
+    }
+  });
+  int L = sharedL;
   // Now L is accurate.
-  // Finally, double-check everything.
-  for (const Position& p : solvable) {
-    int m2 = moves_to_reverse(p, L);
+  // Finally, double-check everything, bypassing the caches that produced those answers.
+  assert(K != 1 || (C == 1 && M == 0));  // the only list is {N}, already reversed
+  run_in_parallel(nthreads, solvable.size(), [&](int, int i) {
+    int m2 = ::moves_to_reverse<N>(solvable[i], L);
     assert(m2 != -1 && m2 <= M);
-  }
+    (void)m2;
+  });
   if (C == 0) {
     printf("N=%d, K=%d: count 0 -- in %d seconds\n", N, K, int(time(NULL) - start));
   } else {
     printf("N=%d, K=%d: count %d, max %d, length %d -- in %d seconds\n", N, K, C, M, L, int(time(NULL) - start));
   }
+  fflush(stdout);
+  return Result{C, M, L};
+}
+
+template<int Min, int... Is>
+auto make_int_range_impl(std::integer_sequence<int, Is...>) {
+  return std::integer_sequence<int, Is+Min...>{};
+}
+
+template<int Min, int Max>
+auto make_int_range() {
+  return make_int_range_impl<Min>(std::make_integer_sequence<int, (Max - Min) + 1>());
+}
+
+template<int... Ns>
+Result solve_n(std::integer_sequence<int, Ns...>, int n, int k) {
+  struct {
+    int n;
+    Result (*action)(int);
+  } array[] = {
+    { Ns, [](int k) { return solve<Ns>(k); } } ...
+  };
+  for (const auto& elt : array) {
+    if (n == elt.n) return elt.action(k);
+  }
+  fprintf(stderr, "oops! n=%d k=%d\n", n, k);
+  exit(1);
+}
+
+Result solve(int n, int k) {
+  return solve_n(make_int_range<MIN_N, MAX_N>(), n, k);
+}
+
+// Print one of the triangular tables from the blog post, with a row for each n
+// and a column for each k; `cell` returns the string to print for (n, k).
+template<class F>
+void print_table(const char *title, int min_n, int max_n, const F& cell) {
+  printf("\n%s\n\n", title);
+  std::vector<size_t> widths(max_n + 1, 0);
+  for (int n = min_n; n <= max_n; ++n) {
+    for (int k = 1; k <= n; ++k) {
+      widths[k] = std::max(widths[k], cell(n, k).size());
+    }
+  }
+  for (int n = min_n; n <= max_n; ++n) {
+    printf("    n=%d:%s", n, (n < 10 ? " " : ""));
+    for (int k = 1; k <= n; ++k) {
+      printf(" %*s", int(widths[k]), cell(n, k).c_str());
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc == 3) {
+    int n = atoi(argv[1]);
+    int k = atoi(argv[2]);
+    if (MIN_N <= n && n <= MAX_N && 1 <= k && k <= n) {
+      solve(n, k);
+      return 0;
+    }
+  } else if (argc == 4 && std::string(argv[1]) == "--grid") {
+    int min_n = atoi(argv[2]);
+    int max_n = atoi(argv[3]);
+    if (MIN_N <= min_n && min_n <= max_n && max_n <= MAX_N) {
+      std::map<std::pair<int, int>, Result> results;
+      for (int n = min_n; n <= max_n; ++n) {
+        for (int k = 1; k <= n; ++k) {
+          results[{n, k}] = solve(n, k);
+        }
+      }
+      print_table("The number of solvable lists C(n,k):", min_n, max_n, [&](int n, int k) {
+        return std::to_string(results[{n, k}].C);
+      });
+      print_table("The maximum number of moves M(n,k):", min_n, max_n, [&](int n, int k) {
+        const Result& r = results[{n, k}];
+        return (r.C == 0) ? std::string("-") : std::to_string(r.M);
+      });
+      print_table("The sufficient intermediate list length L(n,k):", min_n, max_n, [&](int n, int k) {
+        const Result& r = results[{n, k}];
+        return (r.C == 0) ? std::string("-") : std::to_string(r.L);
+      });
+      return 0;
+    }
+  }
+  fprintf(stderr, "Usage: %s N K\n       %s --grid MIN_N MAX_N\n(where N is between %d and %d)\n", argv[0], argv[0], MIN_N, MAX_N);
+  return 1;
 }
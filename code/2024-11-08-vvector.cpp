@@ -1,6 +1,15 @@
+#ifndef VVECTOR_DEBUG
 #define VVECTOR_DEBUG 1
+#endif
+#ifndef VVECTOR_RUN_LENGTH
+#define VVECTOR_RUN_LENGTH 0
+#endif
+#ifndef VVECTOR_BENCHMARK
+#define VVECTOR_BENCHMARK 0
+#endif
 
 #include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
@@ -22,6 +31,12 @@ namespace vvhelper {
   template<class T>
   inline constexpr bool is_trivially_relocatable_v = std::is_trivially_copyable_v<T>;
 #endif
+
+  constexpr int bitsFor(size_t n) {
+    int bits = 0;
+    while ((size_t(1) << bits) < n) ++bits;
+    return bits;
+  }
 } // namespace vvhelper
 
 
@@ -81,16 +96,17 @@ public:
     capacity_(std::exchange(rhs.capacity_, 0)) {}
 
   VVector(const VVector& rhs) : meta_(rhs.meta_), capacity_(rhs.capacity_) {
-    if (meta_.empty()) {
+    if (empty()) {
       data_ = nullptr;
+      capacity_ = 0;
     } else {
       data_ = AlignedDeleter::make(capacity_);
       if constexpr ((std::is_trivially_copy_constructible_v<Ts> && ...)) {
         std::memcpy(data_.get(), rhs.data_.get(), capacity_);
       } else {
-        for (const auto& elt : meta_) {
-          copyImpl[elt.type_](rhs.data_.get() + elt.offset_, data_.get() + elt.offset_);
-        }
+        meta_.forEach([&](Metadata elt) {
+          copyImpl[elt.type()](rhs.data_.get() + elt.offset(), data_.get() + elt.offset());
+        });
       }
     }
   }
@@ -119,15 +135,18 @@ public:
     if constexpr ((std::is_trivially_destructible_v<Ts> && ...)) {
       // do nothing
     } else {
-      for (const auto& elt : meta_) {
-        destroyImpl[elt.type_](data_.get() + elt.offset_);
-      }
+      meta_.forEach([&](Metadata elt) {
+        destroyImpl[elt.type()](data_.get() + elt.offset());
+      });
     }
   }
 
   size_t size() const { return meta_.size(); }
   [[nodiscard]] bool empty() const { return meta_.empty(); }
 
+  // Bytes of heap memory held: the element buffer plus the metadata.
+  size_t allocated_bytes() const { return capacity_ + meta_.allocated_bytes(); }
+
   void resize(size_t n, const std::variant<Ts...>& value) {
     while (size() > n) {
       pop_back();
@@ -139,8 +158,9 @@ public:
 
   template<size_t K>
   const TypeAt<K> *get_if(size_t i) const {
-    if (meta_[i].type_ == K) {
-      return reinterpret_cast<const TypeAt<K>*>(data_.get() + meta_[i].offset_);
+    Metadata elt = meta_[i];
+    if (elt.type() == K) {
+      return reinterpret_cast<const TypeAt<K>*>(data_.get() + elt.offset());
     } else {
       return nullptr;
     }
@@ -157,58 +177,105 @@ public:
     }
   }
 
+  // Calls f(elt) with the i'th element as its actual type,
+  // through a jump table indexed by the element's type.
+  template<class F>
+  decltype(auto) visit(size_t i, F&& f) const {
+    using R = std::invoke_result_t<F&, const TypeAt<0>&>;
+    static constexpr R (*visitImpl[])(F&, const char*) = {
+      +[](F& f, const char *p) -> R { return f(*reinterpret_cast<const Ts*>(p)); }...
+    };
+    Metadata elt = meta_[i];
+    return visitImpl[elt.type()](f, data_.get() + elt.offset());
+  }
+
+  // Calls f(elt) for every element, in order. We dispatch once per run
+  // of back-to-back elements of the same type, not once per element;
+  // within a run it's a plain loop over a `const T*`, which the compiler
+  // is free to unroll and vectorize.
+  template<class F>
+  void for_each(F&& f) const {
+    static constexpr void (*runImpl[])(F&, const char*, size_t) = {
+      +[](F& f, const char *p, size_t n) {
+        const Ts *first = reinterpret_cast<const Ts*>(p);
+        for (size_t k = 0; k < n; ++k) {
+          f(first[k]);
+        }
+      }...
+    };
+    meta_.forEachRun([&](int type, size_t offset, size_t n) {
+      runImpl[type](f, data_.get() + offset, n);
+    });
+  }
+
+  // Like std::transform_reduce(first, last, init, reduce, transform).
+  // The accumulator is passed by value through each run's loop,
+  // so that it can live in a register.
+  template<class T, class Reduce, class Transform>
+  T transform_reduce(T init, Reduce reduce, Transform transform) const {
+    static constexpr T (*runImpl[])(T, Reduce&, Transform&, const char*, size_t) = {
+      +[](T acc, Reduce& reduce, Transform& transform, const char *p, size_t n) -> T {
+        const Ts *first = reinterpret_cast<const Ts*>(p);
+        for (size_t k = 0; k < n; ++k) {
+          acc = reduce(std::move(acc), transform(first[k]));
+        }
+        return acc;
+      }...
+    };
+    meta_.forEachRun([&](int type, size_t offset, size_t n) {
+      init = runImpl[type](std::move(init), reduce, transform, data_.get() + offset, n);
+    });
+    return init;
+  }
+
+  // The elements live somewhere in the middle of `data_`, with headroom
+  // on both sides, and likewise the metadata has headroom at the front.
+  // So push_front normally just constructs the new element right before
+  // the old front; only when the headroom runs out do we move everything
+  // right, by at least as many bytes as are in use, which makes
+  // push_front amortized O(1) just like push_back.
   void push_front(std::variant<Ts...> vvalue) {
-    meta_.reserve(meta_.size() + 1);
+    if (empty()) {
+      push_back(std::move(vvalue));
+      return;
+    }
+    meta_.reserveFront();
     int k = vvalue.index();
-    // Each element needs to slide right by `sizeofImpl[k]` bytes
-    // to make room, but might also need to be bumped for alignment.
-    std::vector<int> newOffsets;
-    int offset = sizeofImpl[k];
-    for (const auto& elt : meta_) {
-      offset = alignUp(offset, alignofImpl[elt.type_]);
-      newOffsets.push_back(offset);
-      offset += sizeofImpl[elt.type_];
-    }
-    reserveImpl(offset);
-    for (int i = meta_.size() - 1; i >= 0; --i) {
-      if (newOffsets[i] > meta_[i].offset_) {
-        relocateOverlappingImpl[meta_[i].type_](data_.get() + meta_[i].offset_, data_.get() + newOffsets[i]);
-        meta_[i].offset_ = newOffsets[i];
-      }
+    if (frontbyte() < sizeofImpl[k]) {
+      size_t live = backbyte() - alignDown(frontbyte(), max_alignment);
+      size_t room = alignUp(std::max(live, sizeofImpl[k]), max_alignment);
+      relayoutImpl(room, growthCapacity(room + live));
     }
+    size_t beginbyte = alignDown(frontbyte() - sizeofImpl[k], alignofImpl[k]);
     [&]() noexcept {
       // If this construction throws, we're in trouble.
       // Punt for now by wrapping it in a noexcept block,
       // so that if it throws we'll `std::terminate`.
       std::visit([&](const auto& value) {
-        copyImpl[k](&value, data_.get() + 0);
+        copyImpl[k](&value, data_.get() + beginbyte);
       }, vvalue);
     }();
-    meta_.insert(meta_.begin(), { k, 0 });
+    meta_.push_front({ k, beginbyte });
   }
 
   void pop_front() {
-    destroyImpl[meta_.front().type_](data_.get() + 0);
-    meta_.erase(meta_.begin());
-    int newOffset = 0;
-    for (auto& elt : meta_) {
-      newOffset = alignUp(newOffset, alignofImpl[elt.type_]);
-      if (newOffset == elt.offset_) {
-        break;
-      }
-      relocateOverlappingImpl[elt.type_](data_.get() + elt.offset_, data_.get() + newOffset);
-      elt.offset_ = newOffset;
-      newOffset += sizeofImpl[elt.type_];
-    }
+    Metadata elt = meta_.front();
+    destroyImpl[elt.type()](data_.get() + elt.offset());
+    meta_.pop_front();
   }
 
   void push_back(std::variant<Ts...> vvalue) {
-    meta_.reserve(meta_.size() + 1);
+    meta_.reserveBack();
     int k = vvalue.index();
-    int beginbyte = meta_.empty() ? 0 : meta_.back().endbyte();
+    size_t beginbyte = empty() ? 0 : backbyte();
     beginbyte = alignUp(beginbyte, alignofImpl[k]);
     if (beginbyte + sizeofImpl[k] > capacity_) {
-      reserveImpl(beginbyte + sizeofImpl[k]);
+      // Slide everything back to the start of the buffer. If pop_front
+      // has left at least half the buffer free, that's enough room;
+      // otherwise grow the buffer too.
+      size_t needed = beginbyte + sizeofImpl[k] - (empty() ? 0 : alignDown(frontbyte(), max_alignment));
+      relayoutImpl(0, growthCapacity(needed));
+      beginbyte = alignUp(empty() ? 0 : backbyte(), alignofImpl[k]);
     }
     std::visit([&](const auto& value) {
       copyImpl[k](&value, data_.get() + beginbyte);
@@ -217,8 +284,8 @@ public:
   }
 
   void pop_back() {
-    const auto& elt = meta_.back();
-    destroyImpl[elt.type_](data_.get() + elt.offset_);
+    Metadata elt = meta_.back();
+    destroyImpl[elt.type()](data_.get() + elt.offset());
     meta_.pop_back();
   }
 
@@ -226,43 +293,338 @@ private:
   static size_t alignUp(size_t n, size_t align) {
     return (n + align - 1) / align * align;
   }
+  static size_t alignDown(size_t n, size_t align) {
+    return n / align * align;
+  }
 
-  void reserveImpl(size_t newcapacity) {
-    if (newcapacity <= capacity_) {
-      return;
+  // Each element's metadata is one uint32_t: the type index in the top
+  // `typeBits` bits, and its byte offset into `data_` in the rest.
+  // That caps the buffer at `max_capacity` bytes (512MB for up to 8 types).
+  static constexpr int typeBits = vvhelper::bitsFor(sizeof...(Ts));
+  static constexpr size_t max_capacity = size_t(1) << (32 - typeBits);
+
+  struct Metadata {
+    uint32_t bits_ = 0;
+    explicit Metadata() = default;
+    Metadata(int type, size_t offset) : bits_(offset) {
+      if constexpr (typeBits != 0) bits_ |= uint32_t(type) << (32 - typeBits);
+    }
+    int type() const {
+      if constexpr (typeBits != 0) return bits_ >> (32 - typeBits);
+      return 0;
+    }
+    size_t offset() const { return bits_ & (max_capacity - 1); }
+    size_t endbyte() const { return offset() + sizeofImpl[type()]; }
+  };
+
+#if VVECTOR_RUN_LENGTH
+  // Metadata only for the first element of each run of same-typed,
+  // back-to-back elements; the k'th element of a run is at the run's
+  // offset plus k * sizeof. Indexing is a binary search over the runs,
+  // but a VVector made of a few long runs needs almost no metadata at all.
+  // Element indices are counted from an arbitrary origin, so that
+  // push_front doesn't renumber the runs.
+  class Index {
+    struct Run {
+      Metadata first_;
+      size_t begin_;  // index of the run's first element
+    };
+    static constexpr size_t origin = size_t(-1) / 2;
+    std::vector<Run> runs_;
+    size_t frontRun_ = 0;  // runs_[0..frontRun_) is headroom for push_front
+    size_t begin_ = origin;
+    size_t end_ = origin;
+
+    const Run *find(size_t j) const {
+      return std::upper_bound(runs_.data() + frontRun_, runs_.data() + runs_.size(), j,
+        [](size_t j, const Run& r) { return j < r.begin_; }) - 1;
+    }
+    void clearIfEmpty() {
+      if (begin_ == end_) {
+        runs_.clear();
+        frontRun_ = 0;
+        begin_ = end_ = origin;
+      }
+    }
+  public:
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+    size_t allocated_bytes() const { return runs_.capacity() * sizeof(Run); }
+    explicit Index() = default;
+    Index(const Index&) = default;
+    Index& operator=(const Index&) = default;
+    // A moved-from Index must be empty, not keep its counters.
+    Index(Index&& rhs) noexcept { swap(rhs); }
+    Index& operator=(Index&& rhs) noexcept {
+      Index(std::move(rhs)).swap(*this);
+      return *this;
+    }
+    void swap(Index& rhs) noexcept {
+      runs_.swap(rhs.runs_);
+      std::swap(frontRun_, rhs.frontRun_);
+      std::swap(begin_, rhs.begin_);
+      std::swap(end_, rhs.end_);
     }
-    newcapacity = alignUp(newcapacity, max_alignment);
-    newcapacity = std::max(newcapacity, 2 * capacity_);
-    auto newdata = AlignedDeleter::make(newcapacity);
 
-    if ((vvhelper::is_trivially_relocatable_v<Ts> && ...)) {
-      std::memcpy(newdata.get(), data_.get(), capacity_);
+    Metadata operator[](size_t i) const {
+      size_t j = begin_ + i;
+      const Run *r = find(j);
+      int type = r->first_.type();
+      return { type, r->first_.offset() + (j - r->begin_) * sizeofImpl[type] };
+    }
+    Metadata front() const { return runs_[frontRun_].first_; }
+    Metadata back() const { return (*this)[size() - 1]; }
+
+    void reserveFront() {
+      if (frontRun_ == 0) {
+        size_t room = std::max<size_t>(runs_.size(), 4);
+        runs_.insert(runs_.begin(), room, Run());
+        frontRun_ = room;
+      }
+    }
+    void reserveBack() {
+      if (runs_.size() == runs_.capacity()) {
+        if (frontRun_ >= runs_.size() - frontRun_) {
+          runs_.erase(runs_.begin(), runs_.begin() + frontRun_);
+          frontRun_ = 0;
+        } else {
+          runs_.reserve(std::max<size_t>(2 * runs_.size(), 4));
+        }
+      }
+    }
+    void push_front(Metadata elt) {
+      begin_ -= 1;
+      if (begin_ + 1 != end_) {
+        Run& r = runs_[frontRun_];
+        if (r.first_.type() == elt.type() && elt.endbyte() == r.first_.offset()) {
+          r = { elt, begin_ };
+          return;
+        }
+      }
+      runs_[--frontRun_] = { elt, begin_ };
+    }
+    void push_back(Metadata elt) {
+      if (!empty()) {
+        Metadata last = back();
+        if (last.type() == elt.type() && last.endbyte() == elt.offset()) {
+          end_ += 1;
+          return;
+        }
+      }
+      runs_.push_back({ elt, end_ });
+      end_ += 1;
+    }
+    void pop_front() {
+      Run& r = runs_[frontRun_];
+      begin_ += 1;
+      if (frontRun_ + 1 < runs_.size() && runs_[frontRun_ + 1].begin_ == begin_) {
+        frontRun_ += 1;
+      } else {
+        r = { Metadata(r.first_.type(), r.first_.endbyte()), begin_ };
+      }
+      clearIfEmpty();
+    }
+    void pop_back() {
+      end_ -= 1;
+      if (runs_.back().begin_ == end_) {
+        runs_.pop_back();
+      }
+      clearIfEmpty();
+    }
+
+    void shift(ptrdiff_t delta) {
+      for (size_t r = frontRun_; r < runs_.size(); ++r) {
+        runs_[r].first_ = Metadata(runs_[r].first_.type(), runs_[r].first_.offset() + delta);
+      }
+    }
+    template<class F>
+    void forEachRun(const F& f) const {
+      for (size_t r = frontRun_; r < runs_.size(); ++r) {
+        size_t n = ((r + 1 < runs_.size()) ? runs_[r + 1].begin_ : end_) - runs_[r].begin_;
+        f(runs_[r].first_.type(), runs_[r].first_.offset(), n);
+      }
+    }
+    template<class F>
+    void forEach(const F& f) const {
+      for (size_t r = frontRun_; r < runs_.size(); ++r) {
+        size_t n = ((r + 1 < runs_.size()) ? runs_[r + 1].begin_ : end_) - runs_[r].begin_;
+        int type = runs_[r].first_.type();
+        for (size_t k = 0; k < n; ++k) {
+          f(Metadata(type, runs_[r].first_.offset() + k * sizeofImpl[type]));
+        }
+      }
+    }
+    template<class F>
+    void forEachReverse(const F& f) const {
+      for (size_t r = runs_.size(); r-- > frontRun_; ) {
+        size_t n = ((r + 1 < runs_.size()) ? runs_[r + 1].begin_ : end_) - runs_[r].begin_;
+        int type = runs_[r].first_.type();
+        for (size_t k = n; k-- > 0; ) {
+          f(Metadata(type, runs_[r].first_.offset() + k * sizeofImpl[type]));
+        }
+      }
+    }
+  };
+#else
+  class Index {
+    std::vector<Metadata> meta_;
+    size_t front_ = 0;  // meta_[0..front_) is headroom for push_front
+
+    void clearIfEmpty() {
+      if (empty()) {
+        meta_.clear();
+        front_ = 0;
+      }
+    }
+  public:
+    size_t size() const { return meta_.size() - front_; }
+    bool empty() const { return meta_.size() == front_; }
+    size_t allocated_bytes() const { return meta_.capacity() * sizeof(Metadata); }
+    explicit Index() = default;
+    Index(const Index&) = default;
+    Index& operator=(const Index&) = default;
+    // A moved-from Index must be empty, not keep its counters.
+    Index(Index&& rhs) noexcept { swap(rhs); }
+    Index& operator=(Index&& rhs) noexcept {
+      Index(std::move(rhs)).swap(*this);
+      return *this;
+    }
+    void swap(Index& rhs) noexcept {
+      meta_.swap(rhs.meta_);
+      std::swap(front_, rhs.front_);
+    }
+
+    Metadata operator[](size_t i) const { return meta_[front_ + i]; }
+    Metadata front() const { return meta_[front_]; }
+    Metadata back() const { return meta_.back(); }
+
+    void reserveFront() {
+      if (front_ == 0) {
+        size_t room = std::max<size_t>(size(), 4);
+        meta_.insert(meta_.begin(), room, Metadata());
+        front_ = room;
+      }
+    }
+    void reserveBack() {
+      if (meta_.size() == meta_.capacity()) {
+        if (front_ >= size()) {
+          meta_.erase(meta_.begin(), meta_.begin() + front_);
+          front_ = 0;
+        } else {
+          meta_.reserve(std::max<size_t>(2 * meta_.size(), 4));
+        }
+      }
+    }
+    void push_front(Metadata elt) { meta_[--front_] = elt; }
+    void push_back(Metadata elt) { meta_.push_back(elt); }
+    void pop_front() { front_ += 1; clearIfEmpty(); }
+    void pop_back() { meta_.pop_back(); clearIfEmpty(); }
+
+    void shift(ptrdiff_t delta) {
+      for (size_t i = front_; i < meta_.size(); ++i) {
+        meta_[i] = Metadata(meta_[i].type(), meta_[i].offset() + delta);
+      }
+    }
+    template<class F>
+    void forEachRun(const F& f) const {
+      // Element i+1 continues element i's run iff it has the same type
+      // and starts where element i ends; in the packed encoding, that's
+      // iff its bits are exactly i's bits plus i's size.
+      for (size_t i = front_; i < meta_.size(); ) {
+        Metadata first = meta_[i];
+        uint32_t step = sizeofImpl[first.type()];
+        uint32_t expected = first.bits_ + step;
+        size_t j = i + 1;
+        while (j < meta_.size() && meta_[j].bits_ == expected) {
+          expected += step;
+          j += 1;
+        }
+        f(first.type(), first.offset(), j - i);
+        i = j;
+      }
+    }
+    template<class F>
+    void forEach(const F& f) const {
+      for (size_t i = front_; i < meta_.size(); ++i) f(meta_[i]);
+    }
+    template<class F>
+    void forEachReverse(const F& f) const {
+      for (size_t i = meta_.size(); i-- > front_; ) f(meta_[i]);
+    }
+  };
+#endif
+
+  size_t frontbyte() const { return meta_.front().offset(); }
+  size_t backbyte() const { return meta_.back().endbyte(); }
+
+  // Double the buffer, unless it's at most half full, in which case
+  // `relayoutImpl` can make room in place.
+  size_t growthCapacity(size_t needed) const {
+    if (needed > max_capacity) {
+      throw std::length_error("VVector");
+    } else if (2 * needed <= capacity_) {
+      return capacity_;
+    } else {
+      return std::min(std::max(needed, 2 * capacity_), max_capacity);
+    }
+  }
+
+  // Move the elements so that the first one's `max_alignment`-aligned
+  // base lands at byte `newbase`, in a buffer of `newcapacity` bytes.
+  // Shifting by a multiple of `max_alignment` keeps every element aligned.
+  // If `newcapacity` is the current capacity, the move is done in place.
+  void relayoutImpl(size_t newbase, size_t newcapacity) {
+    if (empty()) {
+      if (newcapacity > capacity_) {
+        newcapacity = alignUp(newcapacity, max_alignment);
+        data_ = AlignedDeleter::make(newcapacity);
+        capacity_ = newcapacity;
+      }
+      return;
+    }
+    size_t base = alignDown(frontbyte(), max_alignment);
+    size_t end = backbyte();
+    ptrdiff_t shift = ptrdiff_t(newbase) - ptrdiff_t(base);
+    if (newcapacity == capacity_) {
+      if ((vvhelper::is_trivially_relocatable_v<Ts> && ...)) {
+        std::memmove(data_.get() + newbase, data_.get() + base, end - base);
+      } else if (shift < 0) {
+        meta_.forEach([&](Metadata elt) {
+          relocateOverlappingImpl[elt.type()](data_.get() + elt.offset(), data_.get() + elt.offset() + shift);
+        });
+      } else if (shift > 0) {
+        meta_.forEachReverse([&](Metadata elt) {
+          relocateOverlappingImpl[elt.type()](data_.get() + elt.offset(), data_.get() + elt.offset() + shift);
+        });
+      }
     } else {
-      for (const auto& elt : meta_) {
-        relocateImpl[elt.type_](data_.get() + elt.offset_, newdata.get() + elt.offset_);
+      newcapacity = alignUp(newcapacity, max_alignment);
+      auto newdata = AlignedDeleter::make(newcapacity);
+      if ((vvhelper::is_trivially_relocatable_v<Ts> && ...)) {
+        std::memcpy(newdata.get() + newbase, data_.get() + base, end - base);
+      } else {
+        meta_.forEach([&](Metadata elt) {
+          relocateImpl[elt.type()](data_.get() + elt.offset(), newdata.get() + elt.offset() + shift);
+        });
       }
+      data_ = std::move(newdata);
+      capacity_ = newcapacity;
     }
-    data_ = std::move(newdata);
-    capacity_ = newcapacity;
+    meta_.shift(shift);
   }
 
 #if VVECTOR_DEBUG
   friend std::ostream& operator<<(std::ostream& os, const VVector& vv) {
     os << "META TYPES:";
-    for (auto&& elt : vv.meta_) os << " " << elt.type_;
+    vv.meta_.forEach([&](Metadata elt) { os << " " << elt.type(); });
     os << "\nMETA OFFSETS:";
-    for (auto&& elt : vv.meta_) os << " " << elt.offset_;
+    vv.meta_.forEach([&](Metadata elt) { os << " " << elt.offset(); });
     os << "\nCAPACITY: " << vv.capacity_;
     os << "\nPOINTER: " << (void*)vv.data_.get() << "\n";
     return os;
   }
 #endif
 
-  struct Metadata {
-    int type_;
-    int offset_;
-    size_t endbyte() const { return offset_ + sizeofImpl[type_]; }
-  };
   struct AlignedDeleter {
     static auto make(size_t n) {
       void *p = std::aligned_alloc(max_alignment, alignUp(n, max_alignment));
@@ -270,7 +632,7 @@ private:
     }
     void operator()(char *p) const { std::free(p); }
   };
-  std::vector<Metadata> meta_;
+  Index meta_;
   std::unique_ptr<char[], AlignedDeleter> data_ = nullptr;
   size_t capacity_ = 0;
 };
@@ -289,26 +651,147 @@ struct String {
   std::list<int> dummy_;
 };
 
+#if VVECTOR_BENCHMARK
+
+// g++ -std=c++17 -O2 -DVVECTOR_DEBUG=0 -DVVECTOR_BENCHMARK=1 2024-11-08-vvector.cpp
+// Add -DVVECTOR_RUN_LENGTH=1 to see the run-length metadata instead.
+
+#include <chrono>
+#include <functional>
+#include <numeric>
+#include <random>
+
+volatile long long benchmark_sink;
+
+struct Point { int x, y, z; };
+
+template<class F>
+double seconds(const F& f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int rep = 0; rep < 10; ++rep) f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 10;
+}
+
+struct Value {
+  long long operator()(int x) const { return x; }
+  long long operator()(long long x) const { return x; }
+  long long operator()(const Point& p) const { return p.x; }
+};
+
+// Fill both containers with n elements of types int, long long, Point,
+// in runs of `run` same-typed elements (run=1 means the types are random),
+// and time a few ways of summing them.
+void benchmark(const char *name, size_t n, size_t run) {
+  std::mt19937 g(42);
+  VVector<int, long long, Point> vv;
+  std::vector<std::variant<int, long long, Point>> v;
+  int type = 0;
+  for (size_t i = 0; i < n; ++i) {
+    if (i % run == 0) type = g() % 3;
+    std::variant<int, long long, Point> value;
+    if (type == 0) value = int(i);
+    if (type == 1) value = (long long)i;
+    if (type == 2) value = Point{ int(i), 0, 0 };
+    vv.push_back(value);
+    v.push_back(value);
+  }
+  printf("%s: VVector %.2f bytes/elt, vector<variant> %.2f bytes/elt\n",
+    name, double(vv.allocated_bytes()) / n, double(v.capacity() * sizeof(v[0])) / n);
+
+  long long expected = 0;
+  for (const auto& elt : v) expected += std::visit(Value(), elt);
+  auto report = [&](const char *how, long long sum, double vvtime, double vtime) {
+    printf("  %-18s VVector %7.3f ns/elt, vector<variant> %7.3f ns/elt%s\n",
+      how, vvtime * 1e9 / n, vtime * 1e9 / n, (sum == expected) ? "" : "  MISMATCH");
+  };
+
+  long long sum = 0;
+  double vvtime = seconds([&]() {
+    sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (auto *p = vv.get_if<0>(i)) sum += *p;
+      else if (auto *p = vv.get_if<1>(i)) sum += *p;
+      else if (auto *p = vv.get_if<2>(i)) sum += p->x;
+    }
+  });
+  double vtime = seconds([&]() {
+    long long s = 0;
+    for (const auto& elt : v) {
+      if (auto *p = std::get_if<0>(&elt)) s += *p;
+      else if (auto *p = std::get_if<1>(&elt)) s += *p;
+      else if (auto *p = std::get_if<2>(&elt)) s += p->x;
+    }
+    benchmark_sink = s;
+  });
+  report("get_if", sum, vvtime, vtime);
+
+  vvtime = seconds([&]() {
+    sum = 0;
+    for (size_t i = 0; i < n; ++i) sum += vv.visit(i, Value());
+  });
+  vtime = seconds([&]() {
+    long long s = 0;
+    for (const auto& elt : v) s += std::visit(Value(), elt);
+    benchmark_sink = s;
+  });
+  report("visit", sum, vvtime, vtime);
+
+  vvtime = seconds([&]() {
+    sum = 0;
+    vv.for_each([&](const auto& x) { sum += Value()(x); });
+  });
+  vtime = seconds([&]() {
+    long long s = 0;
+    std::for_each(v.begin(), v.end(), [&](const auto& elt) { s += std::visit(Value(), elt); });
+    benchmark_sink = s;
+  });
+  report("for_each", sum, vvtime, vtime);
+
+  vvtime = seconds([&]() {
+    sum = vv.transform_reduce(0LL, std::plus<>(), Value());
+  });
+  vtime = seconds([&]() {
+    benchmark_sink = std::transform_reduce(v.begin(), v.end(), 0LL, std::plus<>(),
+      [](const auto& elt) { return std::visit(Value(), elt); });
+  });
+  report("transform_reduce", sum, vvtime, vtime);
+}
+
+int main() {
+  printf("Metadata: %s\n", VVECTOR_RUN_LENGTH ? "run-length" : "packed uint32_t");
+  benchmark("random types", 1 << 22, 1);
+  benchmark("runs of 16", 1 << 22, 16);
+  benchmark("runs of 1024", 1 << 22, 1024);
+}
+
+#else
+
 int main() {
   VVector<int, String> vv;
 
   vv.push_back(1);
+#if VVECTOR_DEBUG
+  std::cout << vv;
+#endif
   std::cout
-    << vv
     << vv.at<0>(0)
     << std::endl;
 
   vv.push_back("hello world");
+#if VVECTOR_DEBUG
+  std::cout << vv;
+#endif
   std::cout
-    << vv
     << vv.at<0>(0)
     << vv.at<1>(1)
     << std::endl;
 
   vv.resize(3, 2);
 
+#if VVECTOR_DEBUG
+  std::cout << vv;
+#endif
   std::cout
-    << vv
     << vv.at<0>(0)
     << vv.at<1>(1)
     << vv.at<0>(2)
@@ -316,8 +799,10 @@ int main() {
 
   vv.push_front("the curious incident of the dog in the night-time");
 
+#if VVECTOR_DEBUG
+  std::cout << vv;
+#endif
   std::cout
-    << vv
     << vv.at<1>(0)
     << vv.at<0>(1)
     << vv.at<1>(2)
@@ -326,12 +811,63 @@ int main() {
 
   vv.push_front(3);
 
+#if VVECTOR_DEBUG
+  std::cout << vv;
+#endif
   std::cout
-    << vv
     << vv.at<0>(0)
     << vv.at<1>(1)
     << vv.at<0>(2)
     << vv.at<1>(3)
     << vv.at<0>(4)
     << std::endl;
+
+  vv.pop_front();
+  vv.pop_front();
+
+#if VVECTOR_DEBUG
+  std::cout << vv;
+#endif
+  std::cout
+    << vv.at<0>(0)
+    << vv.at<1>(1)
+    << vv.at<0>(2)
+    << std::endl;
+
+  vv.for_each([](const auto& x) { std::cout << x << " "; });
+  std::cout << std::endl;
+
+  // A moved-from VVector is empty and usable.
+  VVector<int, String> moved(std::move(vv));
+  std::cout << moved.size() << " " << vv.size() << " " << vv.empty() << std::endl;
+  vv.push_back(5);
+  vv.push_front("again");
+  vv = std::move(moved);
+  moved.push_back(6);
+  moved.push_front("and again");
+  std::cout
+    << vv.size() << " " << moved.size() << " "
+    << moved.at<1>(0)
+    << moved.at<0>(1)
+    << std::endl;
+
+  // A VVector used as a FIFO queue reuses the room that pop_front frees,
+  // so its footprint stays bounded however many elements pass through.
+  VVector<int, long long> fifo;
+  for (int i = 0; i < 16; ++i) fifo.push_back(i);
+  size_t settled = 0;
+  size_t most = 0;
+  for (int i = 0; i < 2'000'000; ++i) {
+    if (i % 2) fifo.push_back(i);
+    else fifo.push_back((long long)i);
+    fifo.pop_front();
+    if (i == 1000) settled = fifo.allocated_bytes();
+    most = std::max(most, fifo.allocated_bytes());
+  }
+  std::cout
+    << fifo.size() << " "
+    << (most <= settled ? "bounded" : "unbounded")
+    << std::endl;
 }
+
+#endif